@@ -0,0 +1,145 @@
+/**
+ * autotune.c -- search the quadtree parameters for a scene
+ **/
+
+#include "./autotune.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./fasttime.h"
+#include "./quadtree.h"
+
+static const int maxLinesChoices[] = { 16, 24, 32, 50, 75, 100, 150, 250 };
+static const int maxDepthChoices[] = { 4, 5, 6, 7, 8, 9, 10, 12 };
+static const int parallelDepthChoices[] = { 1, 2, 3, 4, 6, 8, 10, 12 };
+
+// Each setting is timed this many times and keeps its best time, and only
+// replaces the best setting so far if it is faster by more than
+// AUTOTUNE_MARGIN, so that noise in the timings does not pick a setting.
+#define AUTOTUNE_REPEATS 2
+#define AUTOTUNE_MARGIN 0.03
+
+#define NUM_CHOICES(choices) ((int) (sizeof(choices) / sizeof(choices[0])))
+
+// The state of the world that a trial changes.
+struct Snapshot {
+  Line* lines;
+  unsigned int numLineWallCollisions;
+  unsigned int numLineLineCollisions;
+  uint64_t numCandidatePairs;
+};
+typedef struct Snapshot Snapshot;
+
+static void Snapshot_take(Snapshot* snapshot, CollisionWorld* cw) {
+  snapshot->lines = malloc(cw->numOfLines * sizeof(Line));
+  assert(snapshot->lines != NULL);
+  for (unsigned int i = 0; i < cw->numOfLines; i++) {
+    snapshot->lines[i] = *cw->lines[i];
+  }
+  snapshot->numLineWallCollisions = cw->numLineWallCollisions;
+  snapshot->numLineLineCollisions = cw->numLineLineCollisions;
+  snapshot->numCandidatePairs = cw->numCandidatePairs;
+}
+
+static void Snapshot_restore(Snapshot* snapshot, CollisionWorld* cw) {
+  for (unsigned int i = 0; i < cw->numOfLines; i++) {
+    *cw->lines[i] = snapshot->lines[i];
+  }
+  PairCache_clear(&cw->pairCache);
+  cw->numLineWallCollisions = snapshot->numLineWallCollisions;
+  cw->numLineLineCollisions = snapshot->numLineLineCollisions;
+  cw->numCandidatePairs = snapshot->numCandidatePairs;
+}
+
+// Run frames frames from the snapshot with params and return their best
+// time over AUTOTUNE_REPEATS runs.  The first frame, which builds the tree
+// from scratch, is not timed, as a full run pays for that only once.
+static double Autotune_trial(CollisionWorld* cw, Snapshot* snapshot,
+                             QuadTreeParams params, unsigned int frames) {
+  double best = 0;
+  for (int r = 0; r < AUTOTUNE_REPEATS; r++) {
+    Snapshot_restore(snapshot, cw);
+    QuadTree_set_params(cw->qt, params);
+    CollisionWorld_updateLines(cw);
+    fasttime_t start = gettime();
+    for (unsigned int f = 0; f < frames; f++) {
+      CollisionWorld_updateLines(cw);
+    }
+    double seconds = tdiff(start, gettime());
+    if (r == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  return best;
+}
+
+// Try each choice for *field and keep the fastest in result.
+static void Autotune_field(CollisionWorld* cw, Snapshot* snapshot,
+                           unsigned int frames, AutotuneResult* result,
+                           int* field, const int* choices, int numChoices) {
+  int best = *field;
+  for (int i = 0; i < numChoices; i++) {
+    if (choices[i] == best) {
+      continue;
+    }
+    *field = choices[i];
+    double seconds = Autotune_trial(cw, snapshot, result->params, frames);
+    result->trials++;
+    if (seconds < result->seconds * (1 - AUTOTUNE_MARGIN)) {
+      result->seconds = seconds;
+      best = choices[i];
+    }
+  }
+  *field = best;
+}
+
+AutotuneResult Autotune_quadtree(CollisionWorld* cw, unsigned int frames) {
+  AutotuneResult result;
+  result.params = cw->qt->params;
+  result.seconds = 0;
+  result.defaultSeconds = 0;
+  result.trials = 0;
+  if (cw->broadPhase == BROAD_PHASE_BVH || frames == 0) {
+    return result;
+  }
+
+  Snapshot snapshot;
+  Snapshot_take(&snapshot, cw);
+  Profile* profile = cw->profile;
+  cw->profile = NULL;
+
+  result.params = QuadTree_default_params();
+  result.defaultSeconds = Autotune_trial(cw, &snapshot, result.params, frames);
+  result.seconds = result.defaultSeconds;
+  result.trials = 1;
+  // The split threshold and depth trade the size of the leaves against the
+  // lines stuck in internal nodes, so tune them before the parallel cutoff.
+  Autotune_field(cw, &snapshot, frames, &result, &result.params.maxLines,
+                 maxLinesChoices, NUM_CHOICES(maxLinesChoices));
+  Autotune_field(cw, &snapshot, frames, &result, &result.params.maxDepth,
+                 maxDepthChoices, NUM_CHOICES(maxDepthChoices));
+  Autotune_field(cw, &snapshot, frames, &result,
+                 &result.params.parallelDepth, parallelDepthChoices,
+                 NUM_CHOICES(parallelDepthChoices));
+
+  // The winner's time was the lowest of many noisy ones, so time it against
+  // the defaults again for a fair comparison.
+  QuadTreeParams defaults = QuadTree_default_params();
+  if (memcmp(&result.params, &defaults, sizeof(QuadTreeParams)) != 0) {
+    result.defaultSeconds = Autotune_trial(cw, &snapshot, defaults, frames);
+    result.seconds = Autotune_trial(cw, &snapshot, result.params, frames);
+    result.trials += 2;
+    if (result.seconds >= result.defaultSeconds) {
+      result.params = defaults;
+      result.seconds = result.defaultSeconds;
+    }
+  }
+
+  Snapshot_restore(&snapshot, cw);
+  QuadTree_set_params(cw->qt, result.params);
+  cw->profile = profile;
+  free(snapshot.lines);
+  return result;
+}
@@ -0,0 +1,32 @@
+/**
+ * autotune.h -- search the quadtree parameters for a scene
+ *
+ * The best leaf size and depth of the quadtree depend on how the lines of a
+ * scene are spread out.  Autotune_quadtree times a short prefix of frames
+ * under different QuadTreeParams, tuning one parameter at a time starting
+ * from the defaults, and leaves the world exactly as it found it apart from
+ * the parameters of its quadtree.
+ **/
+
+#ifndef AUTOTUNE_H_
+#define AUTOTUNE_H_
+
+#include "./collision_world.h"
+#include "./types.h"
+
+struct AutotuneResult {
+  QuadTreeParams params;
+  // Seconds taken by the prefix with params and with the defaults.
+  double seconds;
+  double defaultSeconds;
+  int trials;
+};
+typedef struct AutotuneResult AutotuneResult;
+
+// Time frames frames from the current state under each candidate setting
+// and set the quadtree of collisionWorld to the fastest one.  Does nothing
+// in BROAD_PHASE_BVH mode.
+AutotuneResult Autotune_quadtree(CollisionWorld* collisionWorld,
+                                 unsigned int frames);
+
+#endif  // AUTOTUNE_H_
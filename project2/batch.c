@@ -0,0 +1,70 @@
+/**
+ * batch.c -- simulate many independent scenes in one process
+ **/
+
+#include "./batch.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cilk/cilk.h>
+
+#include "./fasttime.h"
+#include "./line_demo.h"
+
+int Batch_run(char** paths, int numScenes, unsigned int numFrames,
+              double timeStep, bool eventDriven, BroadPhase broadPhase) {
+  LineDemo** demos = calloc(numScenes, sizeof(LineDemo*));
+  if (demos == NULL) {
+    return -1;
+  }
+
+  int failed = 0;
+  for (int i = 0; i < numScenes; i++) {
+    demos[i] = LineDemo_new();
+    if (demos[i] == NULL || LineDemo_loadScene(demos[i], paths[i]) != 0) {
+      fprintf(stderr, "Input file not found or invalid (%s)\n", paths[i]);
+      failed = -1;
+      break;
+    }
+    LineDemo_setNumFrames(demos[i], numFrames);
+    if (timeStep > 0) {
+      LineDemo_setTimeStep(demos[i], timeStep);
+    }
+    LineDemo_setEventDriven(demos[i], eventDriven);
+    LineDemo_setBroadPhase(demos[i], broadPhase);
+  }
+
+  if (failed == 0) {
+    const fasttime_t start_time = gettime();
+    cilk_for (int i = 0; i < numScenes; i++) {
+      while (LineDemo_update(demos[i])) {
+      }
+    }
+    const fasttime_t end_time = gettime();
+
+    for (int i = 0; i < numScenes; i++) {
+      printf("---- RESULTS (%s) ----\n", paths[i]);
+      printf("%u Line-Wall Collisions\n",
+             LineDemo_getNumLineWallCollisions(demos[i]));
+      printf("%u Line-Line Collisions\n",
+             LineDemo_getNumLineLineCollisions(demos[i]));
+      printf("%" PRIu64 " Candidate Pairs Tested\n",
+             LineDemo_getNumCandidatePairs(demos[i]));
+    }
+    printf("---- END RESULTS ----\n");
+    printf("%d scenes, elapsed execution time: %fs\n", numScenes,
+           tdiff(start_time, end_time));
+  }
+
+  for (int i = 0; i < numScenes; i++) {
+    if (demos[i] != NULL && demos[i]->collisionWorld != NULL) {
+      LineDemo_delete(demos[i]);
+    } else {
+      free(demos[i]);
+    }
+  }
+  free(demos);
+  return failed;
+}
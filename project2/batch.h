@@ -0,0 +1,24 @@
+/**
+ * batch.h -- simulate many independent scenes in one process
+ *
+ * Each scene gets its own LineDemo and CollisionWorld.  The scenes are
+ * simulated concurrently by a cilk_for, and each one still uses the
+ * parallelism inside CollisionWorld_updateLines, so a few large scenes and
+ * many small ones both keep the workers busy.  A scene's results are the
+ * same as those of a standalone run with the same options.
+ **/
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdbool.h>
+
+#include "./collision_world.h"
+
+// Simulate numFrames frames of each of the numScenes scenes in paths and
+// print each scene's results, in the order of paths.  A timeStep of 0 keeps
+// the default.  Returns 0 if every scene could be loaded.
+int Batch_run(char** paths, int numScenes, unsigned int numFrames,
+              double timeStep, bool eventDriven, BroadPhase broadPhase);
+
+#endif  // BATCH_H_
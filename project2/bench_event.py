@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Compare the discrete and event-driven (-e) modes at equal accuracy.
+
+For every scene, both modes simulate the same span of time at every
+step in --steps, running
+
+    ./screensaver [-e] -t <step> <frames> <scene>
+
+with frames chosen so that frames * step is --sim-time (the screensaver
+makes one more update than the frames it is given).  The collision counts
+of the reference run, the event-driven mode at the smallest step unless
+--reference says otherwise, stand for the true ones.  For each mode the
+script prints the count error and the frames/sec at every step, and then
+the fastest step whose error is within --tolerance.
+Example:
+
+    make && ./bench_event.py --steps 0.05,0.1,0.25,0.5,1,2,5 input/box.in
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+RESULT_PATTERNS = {
+    "time": r"Elapsed execution time: ([0-9.]+)s",
+    "wall": r"(\d+) Line-Wall Collisions",
+    "line": r"(\d+) Line-Line Collisions",
+}
+
+MODES = ("discrete", "event")
+
+
+def frames_for(args, step):
+    return max(1, int(round(args.sim_time / step)))
+
+
+def run(args, scene, mode, step):
+    cmd = [args.binary, "-t", repr(step)]
+    if mode == "event":
+        cmd.append("-e")
+    cmd += [str(frames_for(args, step) - 1), scene]
+    output = subprocess.check_output(cmd, universal_newlines=True)
+    result = {}
+    for key, pattern in RESULT_PATTERNS.items():
+        match = re.search(pattern, output)
+        if match is None:
+            raise RuntimeError("could not find '%s' in output of %s"
+                               % (key, args.binary))
+        result[key] = float(match.group(1))
+    return result
+
+
+def error(result, reference):
+    """Relative error of the total count of collisions."""
+    total = result["wall"] + result["line"]
+    expected = reference["wall"] + reference["line"]
+    return abs(total - expected) / max(expected, 1.0)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compare the discrete and event-driven modes.")
+    parser.add_argument("scenes", nargs="+", help="input files")
+    parser.add_argument("--binary", default=os.path.join(HERE, "screensaver"),
+                        help="screensaver binary (default ./screensaver)")
+    parser.add_argument("--steps", default="0.05,0.1,0.25,0.5,1,2,5",
+                        help="comma-separated time steps")
+    parser.add_argument("--sim-time", type=float, default=100.0,
+                        help="simulated time per run (default 100)")
+    parser.add_argument("--reference", default="event:min",
+                        help="MODE:STEP of the reference run, STEP being "
+                             "min for the smallest step (default event:min)")
+    parser.add_argument("--tolerance", type=float, default=0.05,
+                        help="largest relative count error (default 0.05)")
+    args = parser.parse_args()
+
+    steps = sorted(float(t) for t in args.steps.split(","))
+    ref_mode, ref_step = args.reference.split(":")
+    if ref_mode not in MODES:
+        parser.error("--reference mode must be one of " + ", ".join(MODES))
+    ref_step = steps[0] if ref_step == "min" else float(ref_step)
+
+    for scene in args.scenes:
+        reference = run(args, scene, ref_mode, ref_step)
+        print("%s: reference %s at step %g, %d wall and %d line collisions"
+              % (os.path.basename(scene), ref_mode, ref_step,
+                 reference["wall"], reference["line"]))
+        print("%9s %6s %8s %8s %10s %8s %10s"
+              % ("mode", "step", "wall", "line", "error", "time",
+                 "frames/s"))
+        best = {}
+        for mode in MODES:
+            for step in steps:
+                result = run(args, scene, mode, step)
+                err = error(result, reference)
+                fps = frames_for(args, step) / max(result["time"], 1e-6)
+                print("%9s %6g %8d %8d %9.1f%% %7.2fs %10.1f"
+                      % (mode, step, result["wall"], result["line"],
+                         100.0 * err, result["time"], fps))
+                sys.stdout.flush()
+                if err <= args.tolerance and (
+                        mode not in best or result["time"] < best[mode][1]):
+                    best[mode] = (step, result["time"])
+        for mode in MODES:
+            if mode not in best:
+                print("%9s: no step within %g%%"
+                      % (mode, 100.0 * args.tolerance))
+                continue
+            step, time = best[mode]
+            print("%9s: fastest within %g%% is step %g, %.2fs, "
+                  "%.1f simulated time/s"
+                  % (mode, 100.0 * args.tolerance, step, time,
+                     args.sim_time / max(time, 1e-6)))
+        print("")
+
+
+if __name__ == "__main__":
+    main()
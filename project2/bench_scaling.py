@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Run screensaver headless over generated scenes and report scaling.
+
+For every scene size and every worker count, runs
+
+    CILK_NWORKERS=<p> ./screensaver <frames> <scene>
+
+and prints ms/frame, candidate pairs tested per frame, line-line
+collisions and the speedup over the first worker count.  Scenes are
+generated with scene_gen.py into --scene-dir unless they already exist;
+their names include a hash of --gen-args, if any.
+Example:
+
+    make && ./bench_scaling.py --sizes 10000,100000,1000000 --workers 1,2,4,8
+"""
+
+import argparse
+import hashlib
+import os
+import re
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+RESULT_PATTERNS = {
+    "time": r"Elapsed execution time: ([0-9.]+)s",
+    "wall": r"(\d+) Line-Wall Collisions",
+    "line": r"(\d+) Line-Line Collisions",
+    "pairs": r"(\d+) Candidate Pairs Tested",
+}
+
+
+def scene_path(args, size):
+    """Scenes made with different --gen-args get different names."""
+    gen_args = " ".join(args.gen_args.split())
+    if not gen_args:
+        return os.path.join(args.scene_dir, "gen_%d.in" % size)
+    digest = hashlib.sha1(gen_args.encode()).hexdigest()[:8]
+    return os.path.join(args.scene_dir, "gen_%d_%s.in" % (size, digest))
+
+
+def make_scene(args, size):
+    path = scene_path(args, size)
+    if os.path.exists(path):
+        return path
+    os.makedirs(args.scene_dir, exist_ok=True)
+    cmd = [sys.executable, os.path.join(HERE, "scene_gen.py"),
+           "-n", str(size), "-o", path] + args.gen_args.split()
+    print("generating " + path, file=sys.stderr)
+    subprocess.check_call(cmd)
+    return path
+
+
+def run(args, scene, workers):
+    env = dict(os.environ, CILK_NWORKERS=str(workers))
+    output = subprocess.check_output(
+        [args.binary, str(args.frames), scene], env=env,
+        universal_newlines=True)
+    result = {}
+    for key, pattern in RESULT_PATTERNS.items():
+        match = re.search(pattern, output)
+        if match is None:
+            raise RuntimeError("could not find '%s' in output of %s"
+                               % (key, args.binary))
+        result[key] = float(match.group(1))
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Measure screensaver scaling on large scenes.")
+    parser.add_argument("--binary", default=os.path.join(HERE, "screensaver"),
+                        help="screensaver binary (default ./screensaver)")
+    parser.add_argument("--sizes", default="10000,100000,1000000",
+                        help="comma-separated line counts")
+    parser.add_argument("--workers", default="1,2,4,8",
+                        help="comma-separated worker counts")
+    parser.add_argument("--frames", type=int, default=100,
+                        help="frames per run (default 100)")
+    parser.add_argument("--scene-dir", default=os.path.join(HERE, "input"),
+                        help="where generated scenes are kept")
+    parser.add_argument("--gen-args", default="",
+                        help="extra arguments passed to scene_gen.py")
+    args = parser.parse_args()
+
+    sizes = [int(s) for s in args.sizes.split(",")]
+    workers = [int(p) for p in args.workers.split(",")]
+
+    print("%9s %7s %10s %14s %12s %8s"
+          % ("lines", "workers", "ms/frame", "pairs/frame", "collisions",
+             "speedup"))
+    for size in sizes:
+        scene = make_scene(args, size)
+        base = None
+        for p in workers:
+            result = run(args, scene, p)
+            ms = 1000.0 * result["time"] / args.frames
+            if base is None:
+                base = ms
+            print("%9d %7d %10.3f %14.1f %12d %8.2f"
+                  % (size, p, ms, result["pairs"] / args.frames,
+                     result["line"], base / ms))
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
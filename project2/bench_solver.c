@@ -0,0 +1,95 @@
+/**
+ * bench_solver.c -- micro-benchmark of intersect() and the collision solver
+ *
+ * Builds random pairs of nearby short lines in the box and times
+ * intersect() on every pair, then CollisionWorld_collisionSolver on every
+ * pair for each intersection type.  The lines are restored before each
+ * round of solves so that every round does the same work.
+ *
+ *   make bench_solver && ./bench_solver [pairs] [rounds]
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./collision_world.h"
+#include "./fasttime.h"
+#include "./intersection_detection.h"
+#include "./line.h"
+
+static double randomIn(double lo, double hi) {
+  return lo + (hi - lo) * (rand() / (double) RAND_MAX);
+}
+
+// A random line centered within .01 of center.
+static Line randomLine(unsigned int id, Vec center) {
+  Line line;
+  memset(&line, 0, sizeof(Line));
+  center = Vec_add(center, Vec_make(randomIn(-.01, .01), randomIn(-.01, .01)));
+  Vec half = Vec_make(randomIn(-.01, .01), randomIn(-.01, .01));
+  line.p1 = Vec_subtract(center, half);
+  line.p2 = Vec_add(center, half);
+  line.velocity = Vec_make(randomIn(-1e-3, 1e-3), randomIn(-1e-3, 1e-3));
+  line.color = RED;
+  line.id = id;
+  return line;
+}
+
+int main(int argc, char* argv[]) {
+  int numPairs = argc > 1 ? atoi(argv[1]) : 4096;
+  int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+  srand(6172);
+
+  CollisionWorld* collisionWorld = CollisionWorld_new(2 * numPairs);
+  Line* lines = malloc(2 * numPairs * sizeof(Line));
+  Line* saved = malloc(2 * numPairs * sizeof(Line));
+  // The two lines of a pair are close, so that many of them collide.
+  for (int i = 0; i < numPairs; i++) {
+    Vec center = Vec_make(randomIn(.55, .95), randomIn(.55, .95));
+    lines[2 * i] = randomLine(2 * i, center);
+    lines[2 * i + 1] = randomLine(2 * i + 1, center);
+  }
+  CollisionWorld_addLines(collisionWorld, lines, 2 * numPairs);
+  memcpy(saved, lines, 2 * numPairs * sizeof(Line));
+
+  // Keep the results live so the calls are not optimized away.
+  int hits = 0;
+  fasttime_t start = gettime();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < numPairs; i++) {
+      hits += intersect(&lines[2 * i], &lines[2 * i + 1],
+                        collisionWorld->timeStep) != NO_INTERSECTION;
+    }
+  }
+  double intersectSeconds = tdiff(start, gettime());
+  printf("intersect():     %7.2f ns/pair (%d pairs hit)\n",
+         intersectSeconds * 1e9 / ((double) rounds * numPairs),
+         hits / rounds);
+
+  IntersectionType types[3] = { L1_WITH_L2, L2_WITH_L1, ALREADY_INTERSECTED };
+  const char* names[3] = { "L1_WITH_L2", "L2_WITH_L1", "ALREADY_INTERSECTED" };
+  double checksum = 0;
+  for (int t = 0; t < 3; t++) {
+    double seconds = 0;
+    for (int r = 0; r < rounds; r++) {
+      memcpy(lines, saved, 2 * numPairs * sizeof(Line));
+      start = gettime();
+      for (int i = 0; i < numPairs; i++) {
+        CollisionWorld_collisionSolver(collisionWorld, &lines[2 * i],
+                                       &lines[2 * i + 1], types[t]);
+      }
+      seconds += tdiff(start, gettime());
+    }
+    for (int i = 0; i < 2 * numPairs; i++) {
+      checksum += lines[i].velocity.x + lines[i].velocity.y;
+    }
+    printf("solver %-20s %7.2f ns/pair\n", names[t],
+           seconds * 1e9 / ((double) rounds * numPairs));
+  }
+  printf("checksum %.17g\n", checksum);
+
+  CollisionWorld_delete(collisionWorld);
+  free(saved);
+  return 0;
+}
@@ -0,0 +1,352 @@
+/**
+ * bvh.c -- bounding-volume hierarchy broad phase
+ **/
+
+#include "./bvh.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <cilk/cilk.h>
+
+#include "./quadtree.h"
+
+// Leaves hold at most this many lines.
+#define BVH_LEAF_LINES 8
+// Subtrees with fewer lines are built and searched serially.
+#define BVH_PARALLEL_CUTOFF 256
+// The tree is rebuilt once refitting has made its internal nodes this much
+// larger in total than after the last rebuild...
+#define BVH_REBUILD_GROWTH 1.5
+// ...or after this many refits.
+#define BVH_REBUILD_INTERVAL 32
+
+BVH* BVH_make() {
+  BVH* bvh = malloc(sizeof(BVH));
+  assert(bvh != NULL);
+  bvh->nodes = NULL;
+  bvh->numNodes = 0;
+  bvh->nodeCapacity = 0;
+  bvh->lines = NULL;
+  bvh->numLines = 0;
+  bvh->lineCapacity = 0;
+  bvh->builtArea = 0;
+  bvh->refits = 0;
+  bvh->rebuilds = 0;
+  return bvh;
+}
+
+void BVH_delete(BVH* bvh) {
+  if (bvh == NULL) {
+    return;
+  }
+  free(bvh->nodes);
+  free(bvh->lines);
+  free(bvh);
+}
+
+static inline Bounds Bounds_union(Bounds a, Bounds b) {
+  Bounds u;
+  u.sw = Vec_make(MIN(a.sw.x, b.sw.x), MIN(a.sw.y, b.sw.y));
+  u.ne = Vec_make(MAX(a.ne.x, b.ne.x), MAX(a.ne.y, b.ne.y));
+  return u;
+}
+
+static inline double Bounds_area(Bounds b) {
+  return (b.ne.x - b.sw.x) * (b.ne.y - b.sw.y);
+}
+
+static inline bool Bounds_intersect(Bounds* a, Bounds* b) {
+  return rect_intersect(&a->sw, &a->ne, &b->sw, &b->ne);
+}
+
+// Twice the center of the line's box along axis (0 = x, 1 = y).
+static inline double BVH_key(Line* line, int axis) {
+  return axis == 0 ? line->sw.x + line->ne.x : line->sw.y + line->ne.y;
+}
+
+// Number of nodes in the subtree built over count lines.
+static int BVH_subtree_nodes(int count) {
+  if (count <= BVH_LEAF_LINES) {
+    return 1;
+  }
+  int left = count / 2;
+  return 1 + BVH_subtree_nodes(left) + BVH_subtree_nodes(count - left);
+}
+
+// Reorders lines so that lines[k] has the key it would have if the lines
+// were sorted by key, with no larger key before it and no smaller one
+// after.
+static void BVH_select(Line** lines, int count, int k, int axis) {
+  int lo = 0;
+  int hi = count - 1;
+  while (lo < hi) {
+    double pivot = BVH_key(lines[lo + (hi - lo) / 2], axis);
+    int i = lo;
+    int j = hi;
+    while (i <= j) {
+      while (BVH_key(lines[i], axis) < pivot) {
+        i++;
+      }
+      while (BVH_key(lines[j], axis) > pivot) {
+        j--;
+      }
+      if (i <= j) {
+        Line* temp = lines[i];
+        lines[i] = lines[j];
+        lines[j] = temp;
+        i++;
+        j--;
+      }
+    }
+    if (k <= j) {
+      hi = j;
+    } else if (k >= i) {
+      lo = i;
+    } else {
+      return;
+    }
+  }
+}
+
+static void BVH_fit_leaf(BVH* bvh, BVHNode* n) {
+  Line** lines = bvh->lines + n->start;
+  Bounds b;
+  b.sw = lines[0]->sw;
+  b.ne = lines[0]->ne;
+  bool bounded = true;
+  for (int i = 0; i < n->count; i++) {
+    Line* line = lines[i];
+    bounded &= line->sw.x <= line->ne.x && line->sw.y <= line->ne.y;
+    b.sw = Vec_make(MIN(b.sw.x, line->sw.x), MIN(b.sw.y, line->sw.y));
+    b.ne = Vec_make(MAX(b.ne.x, line->ne.x), MAX(b.ne.y, line->ne.y));
+  }
+  // A degenerate line can get a NaN box, which rect_intersect finds to
+  // overlap every box, so its leaf has to overlap everything as well.
+  if (!bounded) {
+    b.sw = Vec_make(-INFINITY, -INFINITY);
+    b.ne = Vec_make(INFINITY, INFINITY);
+  }
+  n->bounds = b;
+}
+
+// Builds the subtree rooted at node over lines[start, start + count) of
+// the line buffer.
+static void BVH_build(BVH* bvh, int node, int start, int count) {
+  BVHNode* n = &bvh->nodes[node];
+  n->start = start;
+  n->count = count;
+  if (count <= BVH_LEAF_LINES) {
+    n->right = -1;
+    BVH_fit_leaf(bvh, n);
+    return;
+  }
+
+  // Split at the median along the axis on which the box centers spread
+  // the most.
+  Line** lines = bvh->lines + start;
+  double minX = BVH_key(lines[0], 0);
+  double maxX = minX;
+  double minY = BVH_key(lines[0], 1);
+  double maxY = minY;
+  for (int i = 1; i < count; i++) {
+    double x = BVH_key(lines[i], 0);
+    double y = BVH_key(lines[i], 1);
+    minX = MIN(minX, x);
+    maxX = MAX(maxX, x);
+    minY = MIN(minY, y);
+    maxY = MAX(maxY, y);
+  }
+  int axis = maxX - minX >= maxY - minY ? 0 : 1;
+  int left = count / 2;
+  BVH_select(lines, count, left, axis);
+
+  n->right = node + 1 + BVH_subtree_nodes(left);
+  if (count > BVH_PARALLEL_CUTOFF) {
+    cilk_spawn BVH_build(bvh, node + 1, start, left);
+    BVH_build(bvh, n->right, start + left, count - left);
+    cilk_sync;
+  } else {
+    BVH_build(bvh, node + 1, start, left);
+    BVH_build(bvh, n->right, start + left, count - left);
+  }
+  n->bounds = Bounds_union(bvh->nodes[node + 1].bounds,
+                           bvh->nodes[n->right].bounds);
+}
+
+// Total area of the internal nodes.
+static double BVH_internal_area(BVH* bvh) {
+  double area = 0;
+  for (int i = 0; i < bvh->numNodes; i++) {
+    if (bvh->nodes[i].right >= 0) {
+      area += Bounds_area(bvh->nodes[i].bounds);
+    }
+  }
+  return area;
+}
+
+static void BVH_rebuild(BVH* bvh, Line** lines, int numLines) {
+  if (numLines > bvh->lineCapacity) {
+    bvh->lines = realloc(bvh->lines, numLines * sizeof(Line*));
+    assert(bvh->lines != NULL);
+    bvh->lineCapacity = numLines;
+  }
+  int numNodes = BVH_subtree_nodes(numLines);
+  if (numNodes > bvh->nodeCapacity) {
+    bvh->nodes = realloc(bvh->nodes, numNodes * sizeof(BVHNode));
+    assert(bvh->nodes != NULL);
+    bvh->nodeCapacity = numNodes;
+  }
+  for (int i = 0; i < numLines; i++) {
+    bvh->lines[i] = lines[i];
+  }
+  bvh->numLines = numLines;
+  bvh->numNodes = numNodes;
+  bvh->refits = 0;
+  bvh->rebuilds++;
+
+  BVH_build(bvh, 0, 0, numLines);
+  bvh->builtArea = BVH_internal_area(bvh);
+}
+
+// Recomputes every node's box from its lines' boxes, keeping the shape of
+// the tree.
+static void BVH_refit(BVH* bvh) {
+  BVHNode* nodes = bvh->nodes;
+  cilk_for (int i = 0; i < bvh->numNodes; i++) {
+    if (nodes[i].right < 0) {
+      BVH_fit_leaf(bvh, &nodes[i]);
+    }
+  }
+  // Children come after their parent, so a backward pass sees them first.
+  for (int i = bvh->numNodes - 1; i >= 0; i--) {
+    if (nodes[i].right >= 0) {
+      nodes[i].bounds = Bounds_union(nodes[i + 1].bounds,
+                                     nodes[nodes[i].right].bounds);
+    }
+  }
+  bvh->refits++;
+}
+
+void BVH_invalidate(BVH* bvh) {
+  bvh->refits = BVH_REBUILD_INTERVAL;
+}
+
+void BVH_update(BVH* bvh, Line** lines, int numLines) {
+  if (numLines == 0) {
+    bvh->numLines = 0;
+    bvh->numNodes = 0;
+    return;
+  }
+  if (numLines != bvh->numLines || bvh->refits >= BVH_REBUILD_INTERVAL) {
+    BVH_rebuild(bvh, lines, numLines);
+    return;
+  }
+  BVH_refit(bvh);
+  if (BVH_internal_area(bvh) > BVH_REBUILD_GROWTH * bvh->builtArea) {
+    BVH_rebuild(bvh, lines, numLines);
+  }
+}
+
+// Tests every line of leaf a against every line of leaf b.
+static uint64_t BVH_leaf_pairs(BVH* bvh, BVHNode* a, BVHNode* b,
+                               CollisionWorld* collisionWorld) {
+  uint64_t candidates = 0;
+  Line** linesA = bvh->lines + a->start;
+  Line** linesB = bvh->lines + b->start;
+  for (int i = 0; i < a->count; i++) {
+    Line* line = linesA[i];
+    if (rect_intersect(&line->sw, &line->ne, &b->bounds.sw, &b->bounds.ne)) {
+      candidates += Lines_intersect_line(line, linesB, b->count,
+                                         collisionWorld);
+    }
+  }
+  return candidates;
+}
+
+// Tests the lines under node a against the lines under node b.
+static uint64_t BVH_cross(BVH* bvh, int a, int b,
+                          CollisionWorld* collisionWorld) {
+  BVHNode* na = &bvh->nodes[a];
+  BVHNode* nb = &bvh->nodes[b];
+  if (!Bounds_intersect(&na->bounds, &nb->bounds)) {
+    return 0;
+  }
+  if (na->right < 0 && nb->right < 0) {
+    return BVH_leaf_pairs(bvh, na, nb, collisionWorld);
+  }
+
+  // Descend into the larger of the two nodes.
+  if (nb->right < 0 || (na->right >= 0 && na->count >= nb->count)) {
+    int temp = a;
+    a = b;
+    b = temp;
+    nb = na;
+  }
+  uint64_t left;
+  uint64_t right;
+  if (bvh->nodes[a].count + nb->count > BVH_PARALLEL_CUTOFF) {
+    left = cilk_spawn BVH_cross(bvh, a, b + 1, collisionWorld);
+    right = BVH_cross(bvh, a, nb->right, collisionWorld);
+    cilk_sync;
+  } else {
+    left = BVH_cross(bvh, a, b + 1, collisionWorld);
+    right = BVH_cross(bvh, a, nb->right, collisionWorld);
+  }
+  return left + right;
+}
+
+// Tests the lines under node against each other.
+static uint64_t BVH_self(BVH* bvh, int node, CollisionWorld* collisionWorld) {
+  BVHNode* n = &bvh->nodes[node];
+  if (n->right < 0) {
+    return Lines_intersect(bvh->lines + n->start, n->count, collisionWorld);
+  }
+  uint64_t left;
+  uint64_t right;
+  uint64_t cross;
+  if (n->count > BVH_PARALLEL_CUTOFF) {
+    left = cilk_spawn BVH_self(bvh, node + 1, collisionWorld);
+    right = cilk_spawn BVH_self(bvh, n->right, collisionWorld);
+    cross = BVH_cross(bvh, node + 1, n->right, collisionWorld);
+    cilk_sync;
+  } else {
+    left = BVH_self(bvh, node + 1, collisionWorld);
+    right = BVH_self(bvh, n->right, collisionWorld);
+    cross = BVH_cross(bvh, node + 1, n->right, collisionWorld);
+  }
+  return left + right + cross;
+}
+
+uint64_t BVH_collisions(BVH* bvh, CollisionWorld* collisionWorld) {
+  if (bvh->numNodes == 0) {
+    return 0;
+  }
+  return BVH_self(bvh, 0, collisionWorld);
+}
+
+int BVH_depth(BVH* bvh, int node) {
+  if (bvh->numNodes == 0) {
+    return 0;
+  }
+  BVHNode* n = &bvh->nodes[node];
+  if (n->right < 0) {
+    return 0;
+  }
+  return 1 + MAX(BVH_depth(bvh, node + 1), BVH_depth(bvh, n->right));
+}
+
+void BVH_print_stats(BVH* bvh, FILE* out) {
+  int leaves = 0;
+  for (int i = 0; i < bvh->numNodes; i++) {
+    leaves += bvh->nodes[i].right < 0;
+  }
+  fprintf(out, "---- BVH (%d rebuilds, %d refits since) ----\n",
+          bvh->rebuilds, bvh->refits);
+  fprintf(out, "%d nodes, %d leaves, depth %d, %.1f lines per leaf\n",
+          bvh->numNodes, leaves, BVH_depth(bvh, 0),
+          leaves > 0 ? (double) bvh->numLines / leaves : 0);
+  fprintf(out, "internal node area %.3f (%.3f after rebuild)\n",
+          BVH_internal_area(bvh), bvh->builtArea);
+}
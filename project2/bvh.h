@@ -0,0 +1,45 @@
+/**
+ * bvh.h -- bounding-volume hierarchy broad phase
+ *
+ * An alternative to the quadtree for scenes whose lines are packed in a few
+ * small clusters.  The tree is built over the lines' swept boxes by median
+ * splits along the longer axis of the box centers, so every leaf holds a
+ * handful of lines wherever they are, and no line is ever stuck in an
+ * interior node.  Between rebuilds the node boxes are only refit to the
+ * lines' new boxes.  Candidate pairs are found by a parallel descent of the
+ * tree against itself.
+ **/
+
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./collision_world.h"
+#include "./line.h"
+#include "./types.h"
+
+BVH* BVH_make();
+
+void BVH_delete(BVH* bvh);
+
+// Refits the tree to the lines' current boxes, or rebuilds it when the
+// lines changed, when the refit boxes have grown too much, or when it has
+// not been rebuilt for a while.
+void BVH_update(BVH* bvh, Line** lines, int numLines);
+
+// The lines moved in memory, so rebuild the tree on the next update.
+void BVH_invalidate(BVH* bvh);
+
+// Passes every pair of lines whose boxes overlap to the collision test.
+// Returns the number of such pairs.
+uint64_t BVH_collisions(BVH* bvh, CollisionWorld* collisionWorld);
+
+// Returns the depth of the deepest leaf under node.
+int BVH_depth(BVH* bvh, int node);
+
+// Prints the size and shape of the tree.
+void BVH_print_stats(BVH* bvh, FILE* out);
+
+#endif  // BVH_H_
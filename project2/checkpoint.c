@@ -0,0 +1,207 @@
+/**
+ * checkpoint.c -- save and restore the state of a CollisionWorld
+ **/
+
+#include "./checkpoint.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cilk/cilk.h>
+
+// Number of doubles stored per line: p1, p2 and velocity.
+#define CHECKPOINT_DOUBLES 6
+
+// A serialized checkpoint waiting to be written.  status is the result of
+// a background write, valid once its thread has been joined.
+struct Snapshot {
+  char* path;
+  void* data;
+  size_t size;
+  int status;
+};
+typedef struct Snapshot Snapshot;
+
+static size_t Checkpoint_size(unsigned int numOfLines) {
+  return sizeof(CheckpointHeader)
+      + (size_t) numOfLines * CHECKPOINT_DOUBLES * sizeof(double);
+}
+
+// Serialize the world into a newly allocated snapshot.
+static Snapshot* Snapshot_make(CollisionWorld* collisionWorld,
+                               const char* path, uint64_t frame) {
+  unsigned int n = collisionWorld->numOfLines;
+  Snapshot* snapshot = malloc(sizeof(Snapshot));
+  if (snapshot == NULL) {
+    return NULL;
+  }
+  snapshot->size = Checkpoint_size(n);
+  snapshot->status = 0;
+  snapshot->data = malloc(snapshot->size);
+  snapshot->path = strdup(path);
+  if (snapshot->data == NULL || snapshot->path == NULL) {
+    free(snapshot->data);
+    free(snapshot->path);
+    free(snapshot);
+    return NULL;
+  }
+
+  CheckpointHeader* header = snapshot->data;
+  memset(header, 0, sizeof(CheckpointHeader));
+  memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  header->version = CHECKPOINT_VERSION;
+  header->numOfLines = n;
+  header->frame = frame;
+  header->numLineWallCollisions = collisionWorld->numLineWallCollisions;
+  header->numLineLineCollisions = collisionWorld->numLineLineCollisions;
+  header->numCandidatePairs = collisionWorld->numCandidatePairs;
+
+  double* state = (double*) (header + 1);
+  Line** lines = collisionWorld->lines;
+  // Lines are stored by ID, whatever their order in memory.
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    assert(lines[i]->id < n);
+    double* s = state + (size_t) lines[i]->id * CHECKPOINT_DOUBLES;
+    s[0] = lines[i]->p1.x;
+    s[1] = lines[i]->p1.y;
+    s[2] = lines[i]->p2.x;
+    s[3] = lines[i]->p2.y;
+    s[4] = lines[i]->velocity.x;
+    s[5] = lines[i]->velocity.y;
+  }
+  return snapshot;
+}
+
+static void Snapshot_delete(Snapshot* snapshot) {
+  free(snapshot->data);
+  free(snapshot->path);
+  free(snapshot);
+}
+
+// Write the snapshot next to its destination and rename it into place, so
+// a crash in the middle never leaves a truncated checkpoint behind.
+static int Snapshot_write(Snapshot* snapshot) {
+  size_t length = strlen(snapshot->path);
+  char* tmp = malloc(length + sizeof(".tmp"));
+  if (tmp == NULL) {
+    return -1;
+  }
+  memcpy(tmp, snapshot->path, length);
+  memcpy(tmp + length, ".tmp", sizeof(".tmp"));
+
+  int status = -1;
+  FILE* fout = fopen(tmp, "wb");
+  if (fout != NULL) {
+    bool ok = fwrite(snapshot->data, 1, snapshot->size, fout) == snapshot->size;
+    ok = (fclose(fout) == 0) && ok;
+    if (ok && rename(tmp, snapshot->path) == 0) {
+      status = 0;
+    }
+  }
+  free(tmp);
+  return status;
+}
+
+static void* Snapshot_writeThread(void* arg) {
+  Snapshot* snapshot = arg;
+  snapshot->status = Snapshot_write(snapshot);
+  return NULL;
+}
+
+int CollisionWorld_save(CollisionWorld* collisionWorld, const char* path,
+                        uint64_t frame) {
+  Snapshot* snapshot = Snapshot_make(collisionWorld, path, frame);
+  if (snapshot == NULL) {
+    return -1;
+  }
+  int status = Snapshot_write(snapshot);
+  Snapshot_delete(snapshot);
+  return status;
+}
+
+int CollisionWorld_saveAsync(CollisionWorld* collisionWorld, const char* path,
+                             uint64_t frame) {
+  int previous = CollisionWorld_finishSave(collisionWorld);
+
+  Snapshot* snapshot = Snapshot_make(collisionWorld, path, frame);
+  if (snapshot == NULL) {
+    return -1;
+  }
+  if (pthread_create(&collisionWorld->saveThread, NULL, Snapshot_writeThread,
+                     snapshot) != 0) {
+    // Fall back to writing it ourselves.
+    int status = Snapshot_write(snapshot);
+    Snapshot_delete(snapshot);
+    return status;
+  }
+  collisionWorld->pendingSave = snapshot;
+  return previous;
+}
+
+int CollisionWorld_finishSave(CollisionWorld* collisionWorld) {
+  Snapshot* snapshot = collisionWorld->pendingSave;
+  if (snapshot == NULL) {
+    return 0;
+  }
+  pthread_join(collisionWorld->saveThread, NULL);
+  collisionWorld->pendingSave = NULL;
+  int status = snapshot->status;
+  Snapshot_delete(snapshot);
+  return status;
+}
+
+int CollisionWorld_load(CollisionWorld* collisionWorld, const char* path,
+                        uint64_t* frame) {
+  FILE* fin = fopen(path, "rb");
+  if (fin == NULL) {
+    return -1;
+  }
+
+  unsigned int n = collisionWorld->numOfLines;
+  CheckpointHeader header;
+  if (fread(&header, sizeof(header), 1, fin) != 1
+      || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0
+      || header.version != CHECKPOINT_VERSION
+      || header.numOfLines != n) {
+    fclose(fin);
+    return -1;
+  }
+
+  size_t count = (size_t) n * CHECKPOINT_DOUBLES;
+  double* state = malloc(count * sizeof(double));
+  if (state == NULL || fread(state, sizeof(double), count, fin) != count) {
+    free(state);
+    fclose(fin);
+    return -1;
+  }
+  fclose(fin);
+
+  Line** lines = collisionWorld->lines;
+  double sweep = CollisionWorld_boxSweep(collisionWorld);
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    assert(lines[i]->id < n);
+    double* s = state + (size_t) lines[i]->id * CHECKPOINT_DOUBLES;
+    lines[i]->p1.x = s[0];
+    lines[i]->p1.y = s[1];
+    lines[i]->p2.x = s[2];
+    lines[i]->p2.y = s[3];
+    lines[i]->velocity.x = s[4];
+    lines[i]->velocity.y = s[5];
+    Line_snap(lines[i]);
+    Line_update_box(lines[i], sweep);
+    Line_update_step(lines[i], collisionWorld->timeStep);
+    Line_update_shape(lines[i]);
+  }
+  free(state);
+  PairCache_clear(&collisionWorld->pairCache);
+
+  collisionWorld->numLineWallCollisions = header.numLineWallCollisions;
+  collisionWorld->numLineLineCollisions = header.numLineLineCollisions;
+  collisionWorld->numCandidatePairs = header.numCandidatePairs;
+  *frame = header.frame;
+  return 0;
+}
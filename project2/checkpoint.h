@@ -0,0 +1,52 @@
+/**
+ * checkpoint.h -- save and restore the state of a CollisionWorld
+ *
+ * A checkpoint holds the frame number, the collision and candidate pair
+ * counters and the position and velocity of every line, in line order.  Everything else
+ * (colors, IDs, line lengths) comes from the scene the world was created
+ * from, so a checkpoint can only be loaded on top of that same scene.
+ **/
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include "./collision_world.h"
+
+#define CHECKPOINT_MAGIC "LINECKP"
+#define CHECKPOINT_VERSION 2
+
+struct CheckpointHeader {
+  char magic[8];  // CHECKPOINT_MAGIC, NUL-terminated
+  uint32_t version;
+  uint32_t numOfLines;
+  uint64_t frame;
+  uint32_t numLineWallCollisions;
+  uint32_t numLineLineCollisions;
+  uint64_t numCandidatePairs;
+};
+typedef struct CheckpointHeader CheckpointHeader;
+
+// Write the state of the world after the given frame to path.
+// Returns 0 on success.
+int CollisionWorld_save(CollisionWorld* collisionWorld, const char* path,
+                        uint64_t frame);
+
+// Copy the state of the world and write it to path on a background thread,
+// so the simulation can go on meanwhile.  Each world has its own background
+// write; the world's previous one is waited for first.  Returns 0 if the
+// snapshot was taken and the previous write, if any, succeeded.
+int CollisionWorld_saveAsync(CollisionWorld* collisionWorld, const char* path,
+                             uint64_t frame);
+
+// Wait for the world's background write, if any.  Returns 0 if it
+// succeeded.  CollisionWorld_delete waits too, but cannot report failure.
+int CollisionWorld_finishSave(CollisionWorld* collisionWorld);
+
+// Restore the state saved in path and store its frame number in *frame.
+// Returns 0 on success; on failure the world is left unchanged.
+int CollisionWorld_load(CollisionWorld* collisionWorld, const char* path,
+                        uint64_t* frame);
+
+#endif  // CHECKPOINT_H_
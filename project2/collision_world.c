@@ -22,54 +22,31 @@
  **/
 
 #include "./collision_world.h"
+#include "./continuous.h"
 
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
 #include <stdio.h>
 
+#include "./bvh.h"
+#include "./checkpoint.h"
 #include "./intersection_detection.h"
 #include "./intersection_event_list.h"
 #include "./line.h"
 #include "./quadtree.h"
 #include "./vec.h"
 
-void merge_lists(IntersectionEventList* list1, IntersectionEventList* list2) {
-  if (list2->head == NULL) {
-    return;
-  }
-  if (list1->head == NULL) {
-    list1->head = list2->head;
-  } else {
-    list1->tail->next = list2->head;
-  }
+// The lines are renumbered in Morton order every RENUMBER_INTERVAL frames
+// (0 = never).
+#ifndef RENUMBER_INTERVAL
+#define RENUMBER_INTERVAL 64
+#endif
 
-  list1->tail = list2->tail;
-  list1->size += list2->size;
-  list2->size = 0; list2->head = NULL; list2->tail = NULL;
-}
-
-// Evaluates *left = *left OPERATOR *right.
-void IntersectionEventList_reduce(void* key, void* left, void* right) {
-    merge_lists((IntersectionEventList*) left,
-               (IntersectionEventList*) right);
-}
-
-// Sets *value to the the identity value.
-void IntersectionEventList_identity(void* key, void* value) {
-    ((IntersectionEventList*) value)->head = NULL;
-    ((IntersectionEventList*) value)->tail = NULL;
-    ((IntersectionEventList*) value)->size = 0;
-}
-
-// Destroys any dynamically allocated memory. Hint: delete_nodes.
-void IntersectionEventList_destroy(void* key, void* value) {
-    IntersectionEventList_deleteNodes((IntersectionEventList*) value);
-}
-
-IntersectionEventListReducer X = CILK_C_INIT_REDUCER(IntersectionEventList,
-  IntersectionEventList_reduce,  IntersectionEventList_identity, IntersectionEventList_destroy,
-  (IntersectionEventList) { .head = NULL, .tail = NULL, .size = 0});
+// Frames with fewer events are resolved serially.
+#define RESOLVE_PARALLEL_CUTOFF 256
+// Rounds with fewer events are resolved serially.
+#define RESOLVE_GRAIN 64
 
 
 CollisionWorld* CollisionWorld_new(const unsigned int capacity) {
@@ -80,22 +57,86 @@ CollisionWorld* CollisionWorld_new(const unsigned int capacity) {
     return NULL;
   }
 
+  EventBuffer_init(&collisionWorld->buffer);
+  PairCache_init(&collisionWorld->pairCache, capacity);
+  collisionWorld->events = IntersectionEventList_make();
+  collisionWorld->scratch = IntersectionEventList_make();
+  collisionWorld->broadPhase = BROAD_PHASE_QUADTREE;
   collisionWorld->qt = QuadTree_make();
+  collisionWorld->bvh = BVH_make();
   collisionWorld->numLineWallCollisions = 0;
   collisionWorld->timeStep = 0.5;
+  collisionWorld->eventDriven = false;
   collisionWorld->numLineLineCollisions = 0;
+  collisionWorld->numCandidatePairs = 0;
+  collisionWorld->profile = NULL;
+  collisionWorld->pendingSave = NULL;
   collisionWorld->lines = malloc(capacity * sizeof(Line*));
   collisionWorld->lines_length = malloc(capacity * sizeof(Line*));
   collisionWorld->numOfLines = 0;
+  collisionWorld->lineStore = NULL;
+  collisionWorld->spareStore = NULL;
+  collisionWorld->frames = 0;
+  collisionWorld->line_round = calloc(capacity, sizeof(int));
+  collisionWorld->event_round = NULL;
+  collisionWorld->round_start = NULL;
+  collisionWorld->event_capacity = 0;
+  collisionWorld->schedule = IntersectionEventList_make();
+  collisionWorld->line_time = NULL;
+  collisionWorld->line_version = NULL;
+  collisionWorld->line_pairs_start = NULL;
+  collisionWorld->line_pairs_fill = NULL;
+  collisionWorld->line_index = NULL;
+  collisionWorld->line_max_speed = NULL;
+  collisionWorld->contact_line_capacity = 0;
+  collisionWorld->line_pairs = NULL;
+  collisionWorld->pair_contacts = NULL;
+  collisionWorld->pair_time = NULL;
+  collisionWorld->pair_found = NULL;
+  collisionWorld->pair_first = NULL;
+  collisionWorld->contact_pair_capacity = 0;
+  collisionWorld->contacts = NULL;
+  collisionWorld->contact_capacity = 0;
   return collisionWorld;
 }
 
 void CollisionWorld_delete(CollisionWorld* collisionWorld) {
-  for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    free(collisionWorld->lines[i]);
+  CollisionWorld_finishSave(collisionWorld);
+  if (collisionWorld->profile != NULL) {
+    Profile_delete(collisionWorld->profile);
+  }
+  if (collisionWorld->lineStore != NULL) {
+    free(collisionWorld->lineStore);
+    free(collisionWorld->spareStore);
+  } else {
+    for (int i = 0; i < collisionWorld->numOfLines; i++) {
+      free(collisionWorld->lines[i]);
+    }
   }
   free(collisionWorld->lines);
+  QuadTree_delete(collisionWorld->qt);
+  BVH_delete(collisionWorld->bvh);
   free(collisionWorld->lines_length);
+  free(collisionWorld->line_round);
+  free(collisionWorld->event_round);
+  free(collisionWorld->round_start);
+  free(collisionWorld->line_time);
+  free(collisionWorld->line_version);
+  free(collisionWorld->line_pairs_start);
+  free(collisionWorld->line_pairs_fill);
+  free(collisionWorld->line_index);
+  free(collisionWorld->line_max_speed);
+  free(collisionWorld->line_pairs);
+  free(collisionWorld->pair_contacts);
+  free(collisionWorld->pair_time);
+  free(collisionWorld->pair_found);
+  free(collisionWorld->pair_first);
+  free(collisionWorld->contacts);
+  IntersectionEventList_free(&collisionWorld->schedule);
+  IntersectionEventList_free(&collisionWorld->scratch);
+  IntersectionEventList_free(&collisionWorld->events);
+  EventBuffer_destroy(&collisionWorld->buffer);
+  PairCache_destroy(&collisionWorld->pairCache);
   free(collisionWorld);
 }
 
@@ -105,10 +146,30 @@ unsigned int CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld) {
 
 void CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line) {
   collisionWorld->lines[collisionWorld->numOfLines] = line;
+  Line_snap(line);
   collisionWorld->lines_length[collisionWorld->numOfLines] = Vec_length(Vec_subtract(line->p1, line->p2));
   collisionWorld->numOfLines++;
-  Line_update_box(line);
-  QuadTree_insert(collisionWorld->qt, line);
+  Line_update_box(line, CollisionWorld_boxSweep(collisionWorld));
+  Line_update_step(line, collisionWorld->timeStep);
+  Line_update_shape(line);
+}
+
+void CollisionWorld_addLines(CollisionWorld* collisionWorld, Line* lines,
+                             const unsigned int numOfLines) {
+  assert(collisionWorld->numOfLines == 0);
+
+  collisionWorld->lineStore = lines;
+  double sweep = CollisionWorld_boxSweep(collisionWorld);
+  cilk_for (unsigned int i = 0; i < numOfLines; i++) {
+    Line* line = &lines[i];
+    collisionWorld->lines[i] = line;
+    Line_snap(line);
+    collisionWorld->lines_length[i] = Vec_length(Vec_subtract(line->p1, line->p2));
+    Line_update_box(line, sweep);
+    Line_update_step(line, collisionWorld->timeStep);
+    Line_update_shape(line);
+  }
+  collisionWorld->numOfLines = numOfLines;
 }
 
 Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
@@ -120,109 +181,343 @@ Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
 }
 
 void CollisionWorld_updateLines(CollisionWorld* collisionWorld) {
-  CollisionWorld_detectIntersection(collisionWorld);
-  CollisionWorld_updatePosition(collisionWorld);
-  CollisionWorld_lineWallCollision(collisionWorld);
+  Profile* profile = collisionWorld->profile;
+  uint64_t numCandidatePairs = collisionWorld->numCandidatePairs;
+  unsigned int numLineLineCollisions = collisionWorld->numLineLineCollisions;
+  if (profile != NULL) {
+    Profile_startFrame(profile);
+  }
+
+  if (RENUMBER_INTERVAL > 0
+      && collisionWorld->frames++ % RENUMBER_INTERVAL == 0) {
+    CollisionWorld_renumberLines(collisionWorld);
+  }
+
+  if (collisionWorld->eventDriven) {
+    CollisionWorld_updateLinesEventDriven(collisionWorld);
+  } else {
+    CollisionWorld_detectIntersection(collisionWorld);
+    CollisionWorld_advanceLines(collisionWorld, NULL);
+    Profile_mark(profile, PHASE_ADVANCE);
+  }
+
+  if (profile != NULL) {
+    Profile_endFrame(
+        profile, collisionWorld->numCandidatePairs - numCandidatePairs,
+        collisionWorld->numLineLineCollisions - numLineLineCollisions,
+        collisionWorld->broadPhase == BROAD_PHASE_BVH
+            ? BVH_depth(collisionWorld->bvh, 0)
+            : QuadTree_depth(collisionWorld->qt, 0));
+  }
+}
+
+// Spread the 16 bits of x over the even bits of the result.
+static inline uint32_t Morton_spread(uint32_t x) {
+  x = (x | (x << 8)) & 0x00FF00FF;
+  x = (x | (x << 4)) & 0x0F0F0F0F;
+  x = (x | (x << 2)) & 0x33333333;
+  x = (x | (x << 1)) & 0x55555555;
+  return x;
+}
+
+// Map x in [lo, hi) to 16 bits, clamping what lies outside.
+static inline uint32_t Morton_quantize(double x, double lo, double hi) {
+  double t = (x - lo) / (hi - lo) * 65536;
+  if (!(t > 0)) {
+    return 0;
+  }
+  return t < 65535 ? (uint32_t) t : 65535;
+}
+
+// Z-order code of the midpoint of line.
+static inline uint32_t Line_mortonCode(Line* line) {
+  double x = (line->p1.x + line->p2.x) / 2;
+  double y = (line->p1.y + line->p2.y) / 2;
+  return Morton_spread(Morton_quantize(x, BOX_XMIN, BOX_XMAX))
+      | (Morton_spread(Morton_quantize(y, BOX_YMIN, BOX_YMAX)) << 1);
+}
+
+static int compareKeys(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return x < y ? -1 : x > y;
+}
+
+void CollisionWorld_renumberLines(CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  if (collisionWorld->lineStore == NULL || n == 0) {
+    return;
+  }
+  Line** lines = collisionWorld->lines;
+
+  // Sort the positions in lines by Morton code; ties keep their order.
+  uint64_t* keys = malloc(n * sizeof(uint64_t));
+  int* order = malloc(n * sizeof(int));
+  assert(keys != NULL && order != NULL);
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    keys[i] = ((uint64_t) Line_mortonCode(lines[i]) << 32) | i;
+  }
+  qsort(keys, n, sizeof(uint64_t), compareKeys);
+
+  if (collisionWorld->spareStore == NULL) {
+    collisionWorld->spareStore = malloc(n * sizeof(Line));
+    assert(collisionWorld->spareStore != NULL);
+  }
+  Line* store = collisionWorld->spareStore;
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    order[i] = (int) (keys[i] & 0xFFFFFFFF);
+    store[i] = *lines[order[i]];
+  }
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    lines[i] = &store[i];
+  }
+  collisionWorld->spareStore = collisionWorld->lineStore;
+  collisionWorld->lineStore = store;
+
+  QuadTree_permute(collisionWorld->qt, order, n);
+  BVH_invalidate(collisionWorld->bvh);
+  free(keys);
+  free(order);
+}
+
+void CollisionWorld_setBroadPhase(CollisionWorld* collisionWorld,
+                                  BroadPhase broadPhase) {
+  collisionWorld->broadPhase = broadPhase;
+  QuadTree_setLooseness(collisionWorld->qt,
+                        broadPhase == BROAD_PHASE_LOOSE_QUADTREE
+                            ? LOOSE_QUADTREE_FACTOR : 1);
+}
+
+void CollisionWorld_setPairCache(CollisionWorld* collisionWorld,
+                                 bool enabled) {
+  PairCache_setEnabled(&collisionWorld->pairCache, enabled);
+}
+
+void CollisionWorld_setTimeStep(CollisionWorld* collisionWorld,
+                                double timeStep) {
+  collisionWorld->timeStep = timeStep;
+  double sweep = CollisionWorld_boxSweep(collisionWorld);
+  cilk_for (unsigned int i = 0; i < collisionWorld->numOfLines; i++) {
+    Line_update_box(collisionWorld->lines[i], sweep);
+    Line_update_step(collisionWorld->lines[i], timeStep);
+  }
+}
+
+// Move the line forward by one time step.
+static inline void Line_updatePosition(Line* line, double t) {
+#ifdef FIXED_POINT
+  Line_moveFixed(line, Vec_multiply(line->velocity, t));
+#else
+  line->p1.x += line->velocity.x * t;
+  line->p1.y += line->velocity.y * t;
+  line->p2.x += line->velocity.x * t;
+  line->p2.y += line->velocity.y * t;
+#endif
+}
+
+// Bounce the line off the first wall it has crossed while moving towards
+// it.  Returns 1 if the line bounced, 0 otherwise.
+static inline unsigned int Line_wallCollision(Line* line) {
+  // Right side
+  if ((line->p1.x > BOX_XMAX || line->p2.x > BOX_XMAX)
+      && (line->velocity.x > 0)) {
+    line->velocity.x = -line->velocity.x;
+    return 1;
+  }
+  // Left side
+  if ((line->p1.x < BOX_XMIN || line->p2.x < BOX_XMIN)
+      && (line->velocity.x < 0)) {
+    line->velocity.x = -line->velocity.x;
+    return 1;
+  }
+  // Top side
+  if ((line->p1.y > BOX_YMAX || line->p2.y > BOX_YMAX)
+      && (line->velocity.y > 0)) {
+    line->velocity.y = -line->velocity.y;
+    return 1;
+  }
+  // Bottom side
+  if ((line->p1.y < BOX_YMIN || line->p2.y < BOX_YMIN)
+      && (line->velocity.y < 0)) {
+    line->velocity.y = -line->velocity.y;
+    return 1;
+  }
+  return 0;
 }
 
 void CollisionWorld_updatePosition(CollisionWorld* collisionWorld) {
-  double t = collisionWorld->timeStep; 
+  double t = collisionWorld->timeStep;
   for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    Line *line = collisionWorld->lines[i];
-    // line->p1.x = line->p1.x + line->velocity.x;
-    // line->p1.y = line->p1.y + line->velocity.y;
-    // line->p2.x = line->p2.x + line->velocity.x;
-    // line->p2.y = line->p2.y + line->velocity.y;
-    line->p1 = Vec_add(line->p1, Vec_multiply(line->velocity, t));
-    line->p2 = Vec_add(line->p2, Vec_multiply(line->velocity, t));
+    Line_updatePosition(collisionWorld->lines[i], t);
   }
 }
 
 void CollisionWorld_lineWallCollision(CollisionWorld* collisionWorld) {
   for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    Line *line = collisionWorld->lines[i];
-
-    // Right side
-    if ((line->p1.x > BOX_XMAX || line->p2.x > BOX_XMAX)
-        && (line->velocity.x > 0)) {
-      line->velocity.x = -line->velocity.x;
-      collisionWorld->numLineWallCollisions++;
-      continue;
-    }
-    // Left side
-    if ((line->p1.x < BOX_XMIN || line->p2.x < BOX_XMIN)
-        && (line->velocity.x < 0)) {
-      line->velocity.x = -line->velocity.x;
-      collisionWorld->numLineWallCollisions++;
-      continue;
-    }
-    // Top side
-    if ((line->p1.y > BOX_YMAX || line->p2.y > BOX_YMAX)
-        && (line->velocity.y > 0)) {
-      line->velocity.y = -line->velocity.y;
-      collisionWorld->numLineWallCollisions++;
-      continue;
-    }
-    // Bottom side
-    if ((line->p1.y < BOX_YMIN || line->p2.y < BOX_YMIN)
-        && (line->velocity.y < 0)) {
-      line->velocity.y = -line->velocity.y;
-      collisionWorld->numLineWallCollisions++;
-      continue;
+    collisionWorld->numLineWallCollisions +=
+        Line_wallCollision(collisionWorld->lines[i]);
+  }
+}
+
+void CollisionWorld_advanceLines(CollisionWorld* collisionWorld,
+                                 const double* startTime) {
+  double t = collisionWorld->timeStep;
+  double sweep = CollisionWorld_boxSweep(collisionWorld);
+  Line** lines = collisionWorld->lines;
+
+  CILK_C_REDUCER_OPADD(numWallCollisions, uint, 0);
+  CILK_C_REGISTER_REDUCER(numWallCollisions);
+
+  cilk_for (int i = 0; i < collisionWorld->numOfLines; i++) {
+    Line* line = lines[i];
+    if (startTime == NULL) {
+      PairCache_move(&collisionWorld->pairCache, line, t);
+      Line_updatePosition(line, t);
+    } else {
+      Line_updatePosition(line, t - startTime[line->id]);
     }
+    REDUCER_VIEW(numWallCollisions) += Line_wallCollision(line);
+    // Nothing touches the line again before the next frame's detection,
+    // so its swept box, step and shape can be refreshed here.
+    Line_update_box(line, sweep);
+    Line_update_step(line, t);
+    Line_update_shape(line);
   }
+
+  collisionWorld->numLineWallCollisions += REDUCER_VIEW(numWallCollisions);
+  CILK_C_UNREGISTER_REDUCER(numWallCollisions);
 }
 
 void CollisionWorld_collisionsHelper(CollisionWorld* collisionWorld,
                                      IntersectionEventList* intersectionEventList) {
   // Test all line-line pairs to see if they will intersect before the
-  // next time step.
+  // next time step.  The lines' boxes are already up to date: they are set
+  // by CollisionWorld_addLine and refreshed by CollisionWorld_advanceLines.
+  uint64_t candidatePairs;
+  if (collisionWorld->broadPhase == BROAD_PHASE_BVH) {
+    BVH_update(collisionWorld->bvh, collisionWorld->lines,
+               collisionWorld->numOfLines);
+    Profile_mark(collisionWorld->profile, PHASE_QUADTREE);
+    candidatePairs = BVH_collisions(collisionWorld->bvh, collisionWorld);
+  } else {
+    QuadTree_update(collisionWorld->qt, collisionWorld->lines,
+                    collisionWorld->numOfLines);
+    Profile_mark(collisionWorld->profile, PHASE_QUADTREE);
+    candidatePairs =
+        collisionWorld->broadPhase == BROAD_PHASE_LOOSE_QUADTREE
+            ? QuadTree_loose_collisions(collisionWorld->qt, collisionWorld)
+            : QuadTree_collisions(collisionWorld->qt, 0, collisionWorld);
+  }
+  collisionWorld->numCandidatePairs += candidatePairs;
+  EventBuffer_gather(&collisionWorld->buffer, intersectionEventList);
+  if (!collisionWorld->eventDriven) {
+    PairCache_endFrame(&collisionWorld->pairCache, candidatePairs);
+  }
+  Profile_mark(collisionWorld->profile, PHASE_PAIRS);
+}
 
-    for (int i = 0; i < collisionWorld->numOfLines; i++) {
-      Line_update_box(collisionWorld->lines[i]);
-    }
+void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
+  IntersectionEventList* intersectionEventList = &collisionWorld->events;
+  CollisionWorld_collisionsHelper(collisionWorld, intersectionEventList);
+  collisionWorld->numLineLineCollisions += intersectionEventList->size;
+
+  // Sort the intersection events.
+  IntersectionEventList_sort(intersectionEventList, &collisionWorld->scratch);
+  Profile_mark(collisionWorld->profile, PHASE_SORT);
 
-    QuadTree_update(collisionWorld->qt);
-    QuadTree_collisions(collisionWorld->qt, &REDUCER_VIEW(X), collisionWorld);
+  // Call the collision solver for each intersection event.
+  CollisionWorld_resolveCollisions(collisionWorld, intersectionEventList);
+  Profile_mark(collisionWorld->profile, PHASE_RESOLVE);
+
+  // Keep the buffer around so the next frame does not have to regrow it.
+  IntersectionEventList_clear(intersectionEventList);
 }
 
-void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
-  IntersectionEventList intersectionEventList = IntersectionEventList_make();
-
-  CILK_C_REGISTER_REDUCER(X);
-  CollisionWorld_collisionsHelper(collisionWorld,
-                                  &REDUCER_VIEW(X));
-  intersectionEventList = X.value;
-  collisionWorld->numLineLineCollisions += intersectionEventList.size;
-
-  // Sort the intersection event list.
-  IntersectionEventNode* startNode = intersectionEventList.head;
-  while (startNode != NULL) {
-    IntersectionEventNode* minNode = startNode;
-    IntersectionEventNode* curNode = startNode->next;
-    while (curNode != NULL) {
-      if (IntersectionEventNode_compareData(curNode, minNode) < 0) {
-        minNode = curNode;
-      }
-      curNode = curNode->next;
+// Solves events[begin, end), which must not share any line.
+static void CollisionWorld_resolveRound(CollisionWorld* collisionWorld,
+                                        IntersectionEvent* events,
+                                        int begin, int end) {
+  if (end - begin < RESOLVE_GRAIN) {
+    for (int i = begin; i < end; i++) {
+      CollisionWorld_collisionSolver(collisionWorld, events[i].l1,
+                                     events[i].l2, events[i].intersectionType);
     }
-    if (minNode != startNode) {
-      IntersectionEventNode_swapData(minNode, startNode);
+  } else {
+    cilk_for (int i = begin; i < end; i++) {
+      CollisionWorld_collisionSolver(collisionWorld, events[i].l1,
+                                     events[i].l2, events[i].intersectionType);
     }
-    startNode = startNode->next;
   }
+}
 
-  // Call the collision solver for each intersection event.
-  IntersectionEventNode* curNode = intersectionEventList.head;
+void CollisionWorld_resolveCollisions(
+    CollisionWorld* collisionWorld,
+    IntersectionEventList* intersectionEventList) {
+  int numEvents = intersectionEventList->size;
+  IntersectionEvent* events = intersectionEventList->events;
 
-  while (curNode != NULL) {
-    CollisionWorld_collisionSolver(collisionWorld, curNode->l1, curNode->l2,
-                                   curNode->intersectionType);
-    curNode = curNode->next;
+  if (numEvents < RESOLVE_PARALLEL_CUTOFF) {
+    CollisionWorld_resolveRound(collisionWorld, events, 0, numEvents);
+    return;
+  }
+
+  if (collisionWorld->event_capacity < numEvents) {
+    collisionWorld->event_capacity = intersectionEventList->capacity;
+    free(collisionWorld->event_round);
+    free(collisionWorld->round_start);
+    collisionWorld->event_round =
+        malloc(collisionWorld->event_capacity * sizeof(int));
+    collisionWorld->round_start =
+        malloc((collisionWorld->event_capacity + 1) * sizeof(int));
+  }
+  int* line_round = collisionWorld->line_round;
+  int* event_round = collisionWorld->event_round;
+  int* round_start = collisionWorld->round_start;
+
+  // Color the event graph (lines are vertices, events are edges) greedily
+  // in sorted order: an event goes to the first round after every earlier
+  // event that touches one of its lines.  Each line then sees its events
+  // in the same order as the serial solver, so the velocities come out
+  // bit-identical.
+  int numRounds = 0;
+  for (int i = 0; i < numEvents; i++) {
+    unsigned int id1 = events[i].l1->id;
+    unsigned int id2 = events[i].l2->id;
+    int round = MAX(line_round[id1], line_round[id2]);
+    event_round[i] = round;
+    line_round[id1] = round + 1;
+    line_round[id2] = round + 1;
+    numRounds = MAX(numRounds, round + 1);
+  }
+
+  // Group the events by round, keeping the sorted order inside a round.
+  for (int r = 0; r <= numRounds; r++) {
+    round_start[r] = 0;
+  }
+  for (int i = 0; i < numEvents; i++) {
+    round_start[event_round[i] + 1]++;
+  }
+  for (int r = 0; r < numRounds; r++) {
+    round_start[r + 1] += round_start[r];
   }
 
-  IntersectionEventList_deleteNodes(&REDUCER_VIEW(X));
-  CILK_C_UNREGISTER_REDUCER(X);
+  IntersectionEventList* schedule = &collisionWorld->schedule;
+  IntersectionEventList_reserve(schedule, numEvents);
+  for (int i = 0; i < numEvents; i++) {
+    schedule->events[round_start[event_round[i]]++] = events[i];
+    line_round[events[i].l1->id] = 0;
+    line_round[events[i].l2->id] = 0;
+  }
+  schedule->size = numEvents;
+
+  // round_start[r] now holds the end of round r.
+  int begin = 0;
+  for (int r = 0; r < numRounds; r++) {
+    CollisionWorld_resolveRound(collisionWorld, schedule->events,
+                                begin, round_start[r]);
+    begin = round_start[r];
+  }
+  IntersectionEventList_clear(schedule);
 }
 
 unsigned int CollisionWorld_getNumLineWallCollisions(
@@ -235,6 +530,10 @@ unsigned int CollisionWorld_getNumLineLineCollisions(
   return collisionWorld->numLineLineCollisions;
 }
 
+uint64_t CollisionWorld_getNumCandidatePairs(CollisionWorld* collisionWorld) {
+  return collisionWorld->numCandidatePairs;
+}
+
 void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld,
                                     Line *l1, Line *l2,
                                     IntersectionType intersectionType) {
@@ -275,11 +574,9 @@ void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld,
   Vec face;
   Vec normal;
   if (intersectionType == L1_WITH_L2) {
-    Vec v = Vec_makeFromLine(*l2);
-    face = Vec_normalize(v);
+    face = Vec_normalize(l2->dir);
   } else {
-    Vec v = Vec_makeFromLine(*l1);
-    face = Vec_normalize(v);
+    face = Vec_normalize(l1->dir);
   }
   normal = Vec_orthogonal(face);
 
@@ -25,33 +25,116 @@
 #define COLLISIONWORLD_H_
 
 #include "./line.h"
+#include "./event_buffer.h"
 #include "./intersection_detection.h"
 #include "./intersection_event_list.h"
+#include "./pair_cache.h"
+#include "./profile.h"
 #include "./types.h"
 
+#include <pthread.h>
+#include <stdint.h>
+
 #include <cilk/cilk.h>
 #include <cilk/reducer.h>
+#include <cilk/reducer_opadd.h>
 
-typedef CILK_C_DECLARE_REDUCER(IntersectionEventList) IntersectionEventListReducer;
+// Spatial structure used to find the line pairs whose boxes overlap.
+typedef enum {
+  BROAD_PHASE_QUADTREE,
+  BROAD_PHASE_LOOSE_QUADTREE,  // see QuadTree_setLooseness
+  BROAD_PHASE_BVH  // see bvh.h
+} BroadPhase;
 
+// Everything a simulation uses lives in its CollisionWorld, so several
+// worlds can be updated concurrently.
 struct CollisionWorld {
   // Time step used for simulation
   double timeStep;
 
+  // Advance from contact to contact within a frame instead of detecting
+  // intersections once per frame (see continuous.h).
+  bool eventDriven;
+
   // Container that holds all the lines as an array of Line* lines.
   // This CollisionWorld owns the Line* lines.
   Line** lines;
   unsigned int numOfLines;
 
+  // Contiguous storage of lines added with CollisionWorld_addLines, or NULL.
+  // CollisionWorld_renumberLines copies the lines to spareStore in their
+  // new order and swaps the two.
+  Line* lineStore;
+  Line* spareStore;
+
+  // Number of calls to CollisionWorld_updateLines.
+  unsigned int frames;
+
   double* lines_length;
 
+  BroadPhase broadPhase;
   QuadTree* qt;
+  BVH* bvh;
+
+  // Scratch space for scheduling collision resolution.  line_round holds,
+  // per line ID, the first round in which the line is free again;
+  // event_round holds the round of each event of the current frame.
+  int* line_round;
+  int* event_round;
+  int* round_start;
+  int event_capacity;
+
+  // This frame's events regrouped by round.
+  IntersectionEventList schedule;
+
+  // Scratch space for the event-driven mode (see continuous.c).  The
+  // per-line arrays have room for contact_line_capacity lines, the
+  // per-pair arrays for contact_pair_capacity candidate pairs.
+  double* line_time;
+  unsigned int* line_version;
+  int* line_pairs_start;
+  int* line_pairs_fill;
+  int* line_index;
+  double* line_max_speed;
+  int contact_line_capacity;
+  int* line_pairs;
+  int* pair_contacts;
+  double* pair_time;
+  bool* pair_found;
+  struct Contact* pair_first;
+  int contact_pair_capacity;
+
+  // Storage of the contact queue, kept from frame to frame.
+  struct Contact* contacts;
+  int contact_capacity;
+
+  // Intersection events found in this frame: each worker appends to its
+  // own part of buffer, which is then gathered into events.  scratch is
+  // space to sort them.
+  EventBuffer buffer;
+  IntersectionEventList events;
+  IntersectionEventList scratch;
+
+  // Pairs that cannot collide for a while (see pair_cache.h).  Disabled
+  // unless set with CollisionWorld_setPairCache; never used when
+  // eventDriven.
+  PairCache pairCache;
 
   // Record the total number of line-wall collisions.
   unsigned int numLineWallCollisions;
 
   // Record the total number of line-line intersections.
   unsigned int numLineLineCollisions;
+
+  // Record the total number of line pairs passed to intersect().
+  uint64_t numCandidatePairs;
+
+  // Per-phase timings of each frame, or NULL when not profiling.
+  Profile* profile;
+
+  // Checkpoint being written by saveThread (see checkpoint.h), or NULL.
+  struct Snapshot* pendingSave;
+  pthread_t saveThread;
 };
 typedef struct CollisionWorld CollisionWorld;
 
@@ -66,6 +149,12 @@ unsigned int CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld);
 // This CollisionWorld becomes owner of the Line* line.
 void CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line);
 
+// Add an array of lines into the box.  Must be empty and under capacity.
+// This CollisionWorld becomes owner of the array, which must have been
+// allocated with malloc.
+void CollisionWorld_addLines(CollisionWorld* collisionWorld, Line* lines,
+                             const unsigned int numOfLines);
+
 // Get a line from box.
 Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
                              const unsigned int index);
@@ -73,15 +162,58 @@ Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
 // Update lines' situation in the box.
 void CollisionWorld_updateLines(CollisionWorld* collisionWorld);
 
+// Reorder the lines in memory by the Morton code of their midpoints, so
+// that lines close in the box are close in memory.  The lines keep their
+// IDs, so the simulation does not change.  Does nothing unless the lines
+// were added with CollisionWorld_addLines.
+void CollisionWorld_renumberLines(CollisionWorld* collisionWorld);
+
 // Update position of lines.
 void CollisionWorld_updatePosition(CollisionWorld* collisionWorld);
 
 // Handle line-wall collision.
 void CollisionWorld_lineWallCollision(CollisionWorld* collisionWorld);
 
+// Update position, handle line-wall collision and refresh the bounding box
+// of every line in a single parallel pass.  If startTime is not NULL, the
+// line with ID i has already been moved to time startTime[i] of the frame.
+void CollisionWorld_advanceLines(CollisionWorld* collisionWorld,
+                                 const double* startTime);
+
+// Use broadPhase to find the candidate pairs from the next frame on.
+void CollisionWorld_setBroadPhase(CollisionWorld* collisionWorld,
+                                  BroadPhase broadPhase);
+
+// Skip the pair test for pairs the pair cache shows cannot collide yet.
+void CollisionWorld_setPairCache(CollisionWorld* collisionWorld,
+                                 bool enabled);
+
+// Set the time step and refresh the lines' bounding boxes accordingly.
+void CollisionWorld_setTimeStep(CollisionWorld* collisionWorld,
+                                double timeStep);
+
+// How far ahead in time the lines' bounding boxes reach.  The pair test was
+// tuned with boxes covering one full time unit, so they never cover less.
+static inline double CollisionWorld_boxSweep(CollisionWorld* collisionWorld) {
+  return MAX(collisionWorld->timeStep, 1.0);
+}
+
+// Find the line pairs that may collide in this frame and append them to
+// intersectionEventList.
+void CollisionWorld_collisionsHelper(
+    CollisionWorld* collisionWorld,
+    IntersectionEventList* intersectionEventList);
+
 // Detect line-line intersection.
 void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld);
 
+// Resolve all the events of a sorted event list.  Events that share no
+// line are resolved in parallel; the result is identical to solving them
+// one by one in list order.
+void CollisionWorld_resolveCollisions(
+    CollisionWorld* collisionWorld,
+    IntersectionEventList* intersectionEventList);
+
 // Get total number of line-wall collisions.
 unsigned int CollisionWorld_getNumLineWallCollisions(
     CollisionWorld* collisionWorld);
@@ -90,6 +222,9 @@ unsigned int CollisionWorld_getNumLineWallCollisions(
 unsigned int CollisionWorld_getNumLineLineCollisions(
     CollisionWorld* collisionWorld);
 
+// Get total number of line pairs tested for intersection.
+uint64_t CollisionWorld_getNumCandidatePairs(CollisionWorld* collisionWorld);
+
 // Update the two lines based on their intersection event.
 // Precondition: compareLines(l1, l2) < 0 must be true.
 void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld, Line *l1,
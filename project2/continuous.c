@@ -0,0 +1,507 @@
+/**
+ * continuous.c -- event-driven collision handling
+ *
+ * Each frame is simulated in one or more passes.  A pass starts with every
+ * line at the same time of the frame:
+ *  1. Every line's box is grown by the distance it can travel until the
+ *     end of the frame at CONTACT_SPEED_MARGIN times its speed, or the mean
+ *     speed if that is higher.  The broad phase then finds every pair that
+ *     can touch before the end of the frame, whatever collisions the lines
+ *     go through on the way.
+ *  2. The first contact of every candidate pair, and the first wall each
+ *     line reaches, are computed in parallel and put in a priority queue
+ *     ordered by (time, key).
+ *  3. Contacts are popped in order.  The lines are moved to the contact,
+ *     the collision is solved, and the contacts of every pair involving
+ *     either line are recomputed.  Queued contacts computed before a line's
+ *     last collision are stale and skipped, which is tracked with a
+ *     per-line version number.
+ *  4. If a collision leaves a line faster than the boxes allow for, the
+ *     pass ends there: every line is moved to that time and a new pass
+ *     starts.  Otherwise every line moves for the rest of the frame.
+ *
+ * Lines are only moved when they collide, so each keeps the time of the
+ * frame it has reached in line_time.
+ **/
+
+#include "./continuous.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./intersection_detection.h"
+#include "./intersection_event_list.h"
+#include "./line.h"
+#include "./vec.h"
+
+// The wall a line reaches in a wall contact.
+typedef enum {
+  WALL_NONE,
+  WALL_X,  // left or right
+  WALL_Y   // top or bottom
+} Wall;
+
+// A contact between the lines of candidate pair `pair`, or between the
+// line `line` and a wall.
+struct Contact {
+  double time;
+  uint64_t key;
+  int pair;
+  int line;
+  IntersectionType type;
+  Wall wall;
+  unsigned int version1;
+  unsigned int version2;
+};
+typedef struct Contact Contact;
+
+struct ContactQueue {
+  Contact* contacts;
+  int size;
+  int capacity;
+};
+typedef struct ContactQueue ContactQueue;
+
+static inline bool Contact_before(Contact* a, Contact* b) {
+  return a->time < b->time || (a->time == b->time && a->key < b->key);
+}
+
+static void ContactQueue_siftDown(ContactQueue* queue, int i) {
+  Contact* c = queue->contacts;
+  while (true) {
+    int smallest = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < queue->size && Contact_before(&c[left], &c[smallest])) {
+      smallest = left;
+    }
+    if (right < queue->size && Contact_before(&c[right], &c[smallest])) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      return;
+    }
+    Contact temp = c[i];
+    c[i] = c[smallest];
+    c[smallest] = temp;
+    i = smallest;
+  }
+}
+
+static void ContactQueue_push(ContactQueue* queue, Contact contact) {
+  if (queue->size == queue->capacity) {
+    queue->capacity = MAX(2 * queue->capacity, 64);
+    queue->contacts = realloc(queue->contacts,
+                              queue->capacity * sizeof(Contact));
+    assert(queue->contacts != NULL);
+  }
+  Contact* c = queue->contacts;
+  int i = queue->size++;
+  while (i > 0 && Contact_before(&contact, &c[(i - 1) / 2])) {
+    c[i] = c[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  c[i] = contact;
+}
+
+static Contact ContactQueue_pop(ContactQueue* queue) {
+  assert(queue->size > 0);
+  Contact top = queue->contacts[0];
+  queue->contacts[0] = queue->contacts[--queue->size];
+  ContactQueue_siftDown(queue, 0);
+  return top;
+}
+
+// Make room in the scratch arrays of collisionWorld for numPairs candidate
+// pairs of the lines.  pairCapacity is the capacity to grow the per-pair
+// arrays to, if they are too small.
+static void CollisionWorld_reserveContacts(CollisionWorld* collisionWorld,
+                                           int numPairs, int pairCapacity) {
+  int n = collisionWorld->numOfLines;
+  if (collisionWorld->contact_line_capacity < n) {
+    collisionWorld->contact_line_capacity = n;
+    free(collisionWorld->line_time);
+    free(collisionWorld->line_version);
+    free(collisionWorld->line_pairs_start);
+    free(collisionWorld->line_pairs_fill);
+    free(collisionWorld->line_index);
+    free(collisionWorld->line_max_speed);
+    collisionWorld->line_time = malloc(n * sizeof(double));
+    collisionWorld->line_version = calloc(n, sizeof(unsigned int));
+    collisionWorld->line_pairs_start = malloc((n + 1) * sizeof(int));
+    collisionWorld->line_pairs_fill = malloc(n * sizeof(int));
+    collisionWorld->line_index = malloc(n * sizeof(int));
+    collisionWorld->line_max_speed = malloc(n * sizeof(double));
+    assert(collisionWorld->line_time != NULL
+           && collisionWorld->line_version != NULL
+           && collisionWorld->line_pairs_start != NULL
+           && collisionWorld->line_pairs_fill != NULL
+           && collisionWorld->line_index != NULL
+           && collisionWorld->line_max_speed != NULL);
+  }
+  if (collisionWorld->contact_pair_capacity < numPairs) {
+    collisionWorld->contact_pair_capacity = pairCapacity;
+    free(collisionWorld->line_pairs);
+    free(collisionWorld->pair_contacts);
+    free(collisionWorld->pair_time);
+    free(collisionWorld->pair_found);
+    free(collisionWorld->pair_first);
+    collisionWorld->line_pairs = malloc(2 * pairCapacity * sizeof(int));
+    collisionWorld->pair_contacts = malloc(pairCapacity * sizeof(int));
+    collisionWorld->pair_time = malloc(pairCapacity * sizeof(double));
+    collisionWorld->pair_found = malloc(pairCapacity * sizeof(bool));
+    collisionWorld->pair_first = malloc(pairCapacity * sizeof(Contact));
+    assert(collisionWorld->line_pairs != NULL
+           && collisionWorld->pair_contacts != NULL
+           && collisionWorld->pair_time != NULL
+           && collisionWorld->pair_found != NULL
+           && collisionWorld->pair_first != NULL);
+  }
+}
+
+// Set the line's box to the area within reach of its segment.
+static inline void Line_update_reach(Line* line, double reach) {
+  line->sw.x = MIN(line->p1.x, line->p2.x) - reach;
+  line->sw.y = MIN(line->p1.y, line->p2.y) - reach;
+  line->ne.x = MAX(line->p1.x, line->p2.x) + reach;
+  line->ne.y = MAX(line->p1.y, line->p2.y) + reach;
+}
+
+// Copy of line moved from time `from` to time `to` of the frame.
+static inline Line Line_at(Line* line, double from, double to) {
+  Line moved = *line;
+  Vec delta = Vec_multiply(line->velocity, to - from);
+  moved.p1 = Vec_add(moved.p1, delta);
+  moved.p2 = Vec_add(moved.p2, delta);
+  return moved;
+}
+
+// Move line from time lineTime[line->id] of the frame to time t.
+static inline void Line_advanceTo(Line* line, double* lineTime, double t) {
+  Vec delta = Vec_multiply(line->velocity, t - lineTime[line->id]);
+#ifdef FIXED_POINT
+  Line_moveFixed(line, delta);
+#else
+  line->p1 = Vec_add(line->p1, delta);
+  line->p2 = Vec_add(line->p2, delta);
+#endif
+  Line_update_shape(line);
+  lineTime[line->id] = t;
+}
+
+// Whether the lines cross each other, rather than just touch, and are not
+// already coming apart.  They come apart once the crossing point slides off
+// one of them, so they are coming apart if it moves towards the nearer end
+// of either line.
+static bool Line_stuck(Line* l1, Line* l2) {
+  double e1 = CONTACT_EPSILON * Vec_length(l1->dir);
+  double e2 = CONTACT_EPSILON * Vec_length(l2->dir);
+  double a = Vec_crossProduct(l1->dir, Vec_subtract(l2->p1, l1->p2));
+  double b = Vec_crossProduct(l1->dir, Vec_subtract(l2->p2, l1->p2));
+  double c = Vec_crossProduct(l2->dir, Vec_subtract(l1->p1, l2->p2));
+  double d = Vec_crossProduct(l2->dir, Vec_subtract(l1->p2, l2->p2));
+  if (!((a > e1 && b < -e1) || (a < -e1 && b > e1))
+      || !((c > e2 && d < -e2) || (c < -e2 && d > e2))) {
+    return false;
+  }
+
+  // The crossing point is at l1->p2 + s1 * l1->dir = l2->p2 + s2 * l2->dir.
+  double denominator = Vec_crossProduct(l1->dir, l2->dir);
+  Vec r = Vec_subtract(l2->p2, l1->p2);
+  Vec w = Vec_subtract(l2->velocity, l1->velocity);
+  double s1 = Vec_crossProduct(r, l2->dir) / denominator;
+  double s2 = Vec_crossProduct(r, l1->dir) / denominator;
+  double ds1 = Vec_crossProduct(w, l2->dir) / denominator;
+  double ds2 = Vec_crossProduct(w, l1->dir) / denominator;
+  return !(s1 < 0.5 ? ds1 < 0 : ds1 > 0) && !(s2 < 0.5 ? ds2 < 0 : ds2 > 0);
+}
+
+// Time after which the coordinates lo..hi, moving with velocity v, reach
+// the bound of [min, max] they move towards, or -1 if they do not move.
+static inline double wallTime(double lo, double hi, double v, double min,
+                              double max) {
+  if (v > 0) {
+    return MAX((max - hi) / v, 0);
+  }
+  if (v < 0) {
+    return MAX((min - lo) / v, 0);
+  }
+  return -1;
+}
+
+// Compute the first wall contact after time now of the line, which must be
+// at time now, before the end of the frame.  Returns false if there is
+// none.
+static bool Contact_computeWall(Line* line, int index, double now,
+                                double end, unsigned int* version,
+                                Contact* contact) {
+  double tx = wallTime(MIN(line->p1.x, line->p2.x),
+                       MAX(line->p1.x, line->p2.x), line->velocity.x,
+                       BOX_XMIN, BOX_XMAX);
+  double ty = wallTime(MIN(line->p1.y, line->p2.y),
+                       MAX(line->p1.y, line->p2.y), line->velocity.y,
+                       BOX_YMIN, BOX_YMAX);
+  Wall wall = WALL_NONE;
+  double t = end - now;
+  if (tx >= 0 && tx <= t) {
+    wall = WALL_X;
+    t = tx;
+  }
+  if (ty >= 0 && ty < t) {
+    wall = WALL_Y;
+    t = ty;
+  }
+  if (wall == WALL_NONE) {
+    return false;
+  }
+  // A line ID never shares its key with a pair, whose IDs differ.
+  *contact = (Contact) {
+    .time = now + t, .key = IntersectionEvent_makeKey(line, line),
+    .pair = -1, .line = index, .type = NO_INTERSECTION, .wall = wall,
+    .version1 = version[line->id], .version2 = 0
+  };
+  return true;
+}
+
+// Compute the first contact after time now of the pair event, which must be
+// before the end of the frame.  Returns false if there is none.  Lines of
+// length 0 have no mass to collide with, and would bounce back and forth
+// without end between two lines closing in on them, so they have none.
+static bool Contact_compute(CollisionWorld* collisionWorld,
+                            IntersectionEvent* event, int pair, double now,
+                            double end, Contact* contact) {
+  double* lineTime = collisionWorld->line_time;
+  unsigned int* version = collisionWorld->line_version;
+  if (collisionWorld->lines_length[event->l1->id] == 0
+      || collisionWorld->lines_length[event->l2->id] == 0) {
+    return false;
+  }
+  Line l1 = Line_at(event->l1, lineTime[event->l1->id], now);
+  Line l2 = Line_at(event->l2, lineTime[event->l2->id], now);
+  double t;
+  IntersectionType type = contactTime(&l1, &l2, end - now, &t);
+  if (type == NO_INTERSECTION) {
+    return false;
+  }
+  *contact = (Contact) {
+    .time = now + t, .key = event->key, .pair = pair, .line = -1,
+    .type = type, .wall = WALL_NONE, .version1 = version[event->l1->id],
+    .version2 = version[event->l2->id]
+  };
+  return true;
+}
+
+// Push the next contacts of the line at index `index`, which has just
+// collided at time now: its wall contact and those of its pairs but `skip`.
+static void ContactQueue_pushLine(ContactQueue* queue,
+                                  CollisionWorld* collisionWorld, int index,
+                                  IntersectionEvent* events, int skip,
+                                  double now, double end) {
+  Line* line = collisionWorld->lines[index];
+  int* start = collisionWorld->line_pairs_start;
+  Contact next;
+  if (Contact_computeWall(line, index, now, end,
+                          collisionWorld->line_version, &next)) {
+    ContactQueue_push(queue, next);
+  }
+  for (int j = start[line->id]; j < start[line->id + 1]; j++) {
+    int pair = collisionWorld->line_pairs[j];
+    if (pair == skip
+        || (collisionWorld->pair_time[pair] == now
+            && collisionWorld->pair_contacts[pair] >= MAX_PAIR_CONTACTS)) {
+      continue;
+    }
+    if (Contact_compute(collisionWorld, &events[pair], pair, now, end,
+                        &next)) {
+      ContactQueue_push(queue, next);
+    }
+  }
+}
+
+// Resolve the contacts from time now, when every line is at now, to the end
+// of the frame.  Returns the time the pass stopped at: the end of the
+// frame, or an earlier time if a new pass must start there.
+static double CollisionWorld_contactPass(CollisionWorld* collisionWorld,
+                                         double now, double end) {
+  unsigned int n = collisionWorld->numOfLines;
+  Line** lines = collisionWorld->lines;
+  int* index = collisionWorld->line_index;
+
+  // Slow lines may be hit by faster ones, so every line is allowed at least
+  // the mean speed.
+  double* maxSpeed = collisionWorld->line_max_speed;
+  double totalSpeed = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    totalSpeed += Vec_length(lines[i]->velocity);
+  }
+  double meanSpeed = n > 0 ? totalSpeed / n : 0;
+  cilk_for (unsigned int i = 0; i < n; i++) {
+    Line* line = lines[i];
+    maxSpeed[line->id] = CONTACT_SPEED_MARGIN
+        * MAX(Vec_length(line->velocity), meanSpeed);
+    Line_update_reach(line, maxSpeed[line->id] * (end - now));
+    index[line->id] = i;
+  }
+
+  IntersectionEventList* pairs = &collisionWorld->events;
+  CollisionWorld_collisionsHelper(collisionWorld, pairs);
+  IntersectionEventList_sort(pairs, &collisionWorld->scratch);
+  Profile_mark(collisionWorld->profile, PHASE_SORT);
+  IntersectionEvent* events = pairs->events;
+  int numPairs = pairs->size;
+
+  CollisionWorld_reserveContacts(collisionWorld, numPairs, pairs->capacity);
+  double* lineTime = collisionWorld->line_time;
+  unsigned int* version = collisionWorld->line_version;
+  int* pairContacts = collisionWorld->pair_contacts;
+  double* pairTime = collisionWorld->pair_time;
+  bool* found = collisionWorld->pair_found;
+  Contact* first = collisionWorld->pair_first;
+
+  // Pairs by line ID, to find the pairs to recompute after a collision.
+  int* start = collisionWorld->line_pairs_start;
+  int* fill = collisionWorld->line_pairs_fill;
+  int* adj = collisionWorld->line_pairs;
+  for (unsigned int i = 0; i <= n; i++) {
+    start[i] = 0;
+  }
+  for (int i = 0; i < numPairs; i++) {
+    start[events[i].l1->id + 1]++;
+    start[events[i].l2->id + 1]++;
+  }
+  for (unsigned int i = 0; i < n; i++) {
+    start[i + 1] += start[i];
+    fill[i] = start[i];
+  }
+  for (int i = 0; i < numPairs; i++) {
+    adj[fill[events[i].l1->id]++] = i;
+    adj[fill[events[i].l2->id]++] = i;
+  }
+
+  // Lines stuck in each other at the start of the pass are pushed apart
+  // first; the others get their first contact.  Overlapping parallel lines
+  // have no single crossing point to push them apart from, so they are
+  // left to slide past each other.
+  cilk_for (int i = 0; i < numPairs; i++) {
+    Line* l1 = events[i].l1;
+    Line* l2 = events[i].l2;
+    pairContacts[i] = 0;
+    if (Line_stuck(l1, l2)) {
+      first[i] = (Contact) {
+        .time = now, .key = events[i].key, .pair = i, .line = -1,
+        .type = ALREADY_INTERSECTED, .wall = WALL_NONE,
+        .version1 = version[l1->id], .version2 = version[l2->id]
+      };
+      found[i] = true;
+    } else {
+      found[i] = Contact_compute(collisionWorld, &events[i], i, now, end,
+                                 &first[i]);
+    }
+  }
+
+  ContactQueue queue = {
+    .contacts = collisionWorld->contacts, .size = 0,
+    .capacity = collisionWorld->contact_capacity
+  };
+  for (int i = 0; i < numPairs; i++) {
+    if (found[i]) {
+      ContactQueue_push(&queue, first[i]);
+    }
+  }
+  for (unsigned int i = 0; i < n; i++) {
+    Contact wall;
+    if (Contact_computeWall(lines[i], i, now, end, version, &wall)) {
+      ContactQueue_push(&queue, wall);
+    }
+  }
+
+  double stop = end;
+  while (queue.size > 0) {
+    Contact contact = ContactQueue_pop(&queue);
+
+    if (contact.pair < 0) {
+      Line* line = lines[contact.line];
+      if (contact.version1 != version[line->id]) {
+        continue;
+      }
+      Line_advanceTo(line, lineTime, contact.time);
+      if (contact.wall == WALL_X) {
+        line->velocity.x = -line->velocity.x;
+      } else {
+        line->velocity.y = -line->velocity.y;
+      }
+      collisionWorld->numLineWallCollisions++;
+      version[line->id]++;
+      ContactQueue_pushLine(&queue, collisionWorld, contact.line, events, -1,
+                            contact.time, end);
+      continue;
+    }
+
+    IntersectionEvent* event = &events[contact.pair];
+    Line* l1 = event->l1;
+    Line* l2 = event->l2;
+    if (contact.version1 != version[l1->id]
+        || contact.version2 != version[l2->id]) {
+      continue;
+    }
+
+    Line_advanceTo(l1, lineTime, contact.time);
+    Line_advanceTo(l2, lineTime, contact.time);
+    CollisionWorld_collisionSolver(collisionWorld, l1, l2, contact.type);
+    collisionWorld->numLineLineCollisions++;
+    version[l1->id]++;
+    version[l2->id]++;
+    if (pairTime[contact.pair] == contact.time) {
+      pairContacts[contact.pair]++;
+    } else {
+      pairTime[contact.pair] = contact.time;
+      pairContacts[contact.pair] = 1;
+    }
+
+    // Lines faster than their boxes allow for could reach pairs the broad
+    // phase missed.
+    if (Vec_length(l1->velocity) > maxSpeed[l1->id]
+        || Vec_length(l2->velocity) > maxSpeed[l2->id]) {
+      stop = contact.time;
+      break;
+    }
+
+    // Both lines changed course: their contacts need recomputing.
+    ContactQueue_pushLine(&queue, collisionWorld, index[l1->id], events, -1,
+                          contact.time, end);
+    ContactQueue_pushLine(&queue, collisionWorld, index[l2->id], events,
+                          contact.pair, contact.time, end);
+  }
+
+  collisionWorld->contacts = queue.contacts;
+  collisionWorld->contact_capacity = queue.capacity;
+  IntersectionEventList_clear(pairs);
+
+  if (stop < end) {
+    cilk_for (unsigned int i = 0; i < n; i++) {
+      Line_advanceTo(lines[i], lineTime, stop);
+    }
+  }
+  return stop;
+}
+
+void CollisionWorld_updateLinesEventDriven(CollisionWorld* collisionWorld) {
+  unsigned int n = collisionWorld->numOfLines;
+  double end = collisionWorld->timeStep;
+
+  CollisionWorld_reserveContacts(collisionWorld, 0, 0);
+  double* lineTime = collisionWorld->line_time;
+  for (unsigned int i = 0; i < n; i++) {
+    lineTime[i] = 0;
+  }
+
+  double now = 0;
+  while (now < end) {
+    now = CollisionWorld_contactPass(collisionWorld, now, end);
+  }
+  Profile_mark(collisionWorld->profile, PHASE_RESOLVE);
+
+  CollisionWorld_advanceLines(collisionWorld, lineTime);
+  Profile_mark(collisionWorld->profile, PHASE_ADVANCE);
+}
@@ -0,0 +1,31 @@
+/**
+ * continuous.h -- event-driven collision handling
+ *
+ * Instead of testing every pair once per frame and resolving all the
+ * collisions at the start of the frame, the event-driven mode computes when
+ * each candidate pair first touches during the frame and resolves the
+ * contacts in time order, advancing each line only up to its contacts.
+ * Walls are contacts too.  The candidate pairs come from the usual broad
+ * phase run on boxes that cover everywhere a line can get to before the
+ * end of the frame, so the time step can be made large without lines
+ * tunneling through each other.
+ **/
+
+#ifndef CONTINUOUS_H_
+#define CONTINUOUS_H_
+
+#include "./collision_world.h"
+
+// The broad phase of a pass allows for each line going up to this many
+// times as fast as it, or as the mean speed, at the start of the pass.  A
+// collision that makes a line faster ends the pass.
+#define CONTACT_SPEED_MARGIN 3
+
+// Stop recomputing the contact of a pair after this many collisions at the
+// same time, so that lines caught between others cannot stall the frame.
+#define MAX_PAIR_CONTACTS 4
+
+// Event-driven version of CollisionWorld_updateLines.
+void CollisionWorld_updateLinesEventDriven(CollisionWorld* collisionWorld);
+
+#endif  // CONTINUOUS_H_
@@ -0,0 +1,114 @@
+/**
+ * event_buffer.c -- per-worker buffers for intersection events
+ **/
+
+#include "./event_buffer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static EventChunk* EventChunk_new() {
+  EventChunk* chunk = malloc(sizeof(EventChunk));
+  assert(chunk != NULL);
+  chunk->next = NULL;
+  chunk->size = 0;
+  return chunk;
+}
+
+static void EventChunk_freeAll(EventChunk* chunk) {
+  while (chunk != NULL) {
+    EventChunk* next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+}
+
+void EventBuffer_init(EventBuffer* buffer) {
+  // Threads that are not Cilk workers but enter Cilk code get worker
+  // numbers past nworkers, so count them as well.
+  buffer->numWorkers = __cilkrts_get_total_workers();
+  buffer->workers = calloc(buffer->numWorkers, sizeof(WorkerEvents));
+  assert(buffer->workers != NULL);
+  for (int i = 0; i < buffer->numWorkers; i++) {
+    buffer->workers[i].current = EventChunk_new();
+  }
+  buffer->chunks = NULL;
+  buffer->chunkCapacity = 0;
+}
+
+void EventBuffer_destroy(EventBuffer* buffer) {
+  for (int i = 0; i < buffer->numWorkers; i++) {
+    EventChunk_freeAll(buffer->workers[i].current);
+    EventChunk_freeAll(buffer->workers[i].full);
+    EventChunk_freeAll(buffer->workers[i].spare);
+  }
+  free(buffer->workers);
+  free(buffer->chunks);
+}
+
+EventChunk* EventBuffer_nextChunk(WorkerEvents* worker) {
+  EventChunk* chunk = worker->spare;
+  if (chunk != NULL) {
+    worker->spare = chunk->next;
+  } else {
+    chunk = EventChunk_new();
+  }
+  worker->current->next = worker->full;
+  worker->full = worker->current;
+  chunk->next = NULL;
+  chunk->size = 0;
+  worker->current = chunk;
+  return chunk;
+}
+
+void EventBuffer_gather(EventBuffer* buffer, IntersectionEventList* list) {
+  // Collect the non-empty chunks, and where each one goes in list.
+  int numChunks = 0;
+  int total = list->size;
+  for (int i = 0; i < buffer->numWorkers; i++) {
+    WorkerEvents* worker = &buffer->workers[i];
+    worker->current->next = worker->full;
+    for (EventChunk* c = worker->current; c != NULL; c = c->next) {
+      if (c->size == 0) {
+        continue;
+      }
+      if (numChunks == buffer->chunkCapacity) {
+        buffer->chunkCapacity = MAX(2 * buffer->chunkCapacity, 64);
+        buffer->chunks = realloc(buffer->chunks,
+                                 buffer->chunkCapacity * sizeof(EventChunk*));
+        assert(buffer->chunks != NULL);
+      }
+      buffer->chunks[numChunks++] = c;
+      total += c->size;
+    }
+  }
+
+  IntersectionEventList_reserve(list, total);
+  IntersectionEvent* events = list->events;
+  int start = list->size;
+  EventChunk** chunks = buffer->chunks;
+  // The copies are bound by memory bandwidth, so a serial pass is enough.
+  for (int i = 0; i < numChunks; i++) {
+    memcpy(events + start, chunks[i]->events,
+           chunks[i]->size * sizeof(IntersectionEvent));
+    start += chunks[i]->size;
+  }
+  list->size = total;
+
+  // Keep one chunk per worker as current and put the rest aside for reuse.
+  for (int i = 0; i < buffer->numWorkers; i++) {
+    WorkerEvents* worker = &buffer->workers[i];
+    EventChunk* current = worker->current;
+    EventChunk* c = current->next;
+    while (c != NULL) {
+      EventChunk* next = c->next;
+      c->next = worker->spare;
+      worker->spare = c;
+      c = next;
+    }
+    current->next = NULL;
+    current->size = 0;
+    worker->full = NULL;
+  }
+}
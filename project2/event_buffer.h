@@ -0,0 +1,86 @@
+/**
+ * event_buffer.h -- per-worker buffers for intersection events
+ *
+ * The pair tests of a frame append their events to a buffer owned by the
+ * calling worker, so appends never synchronize.  Each worker's buffer is a
+ * chain of fixed-size chunks; chunks are kept across frames and only
+ * allocated when a worker finds more events than it ever has before, so
+ * once warmed up the pair tests never call malloc.  At the end of the pair
+ * tests, EventBuffer_gather copies every chunk into a single list.
+ **/
+
+#ifndef EVENTBUFFER_H_
+#define EVENTBUFFER_H_
+
+#include <assert.h>
+
+#include <cilk/cilk_api.h>
+
+#include "./intersection_event_list.h"
+
+#define EVENT_CHUNK_SIZE 512
+
+struct EventChunk {
+  struct EventChunk* next;
+  int size;
+  IntersectionEvent events[EVENT_CHUNK_SIZE];
+};
+typedef struct EventChunk EventChunk;
+
+// The chunks of one worker, padded to a cache line so that workers do not
+// share lines.  current is never NULL; full chains the chunks filled this
+// frame, and spare the chunks to reuse.
+struct WorkerEvents {
+  EventChunk* current;
+  EventChunk* full;
+  EventChunk* spare;
+  char padding[64 - 3 * sizeof(EventChunk*)];
+};
+typedef struct WorkerEvents WorkerEvents;
+
+struct EventBuffer {
+  WorkerEvents* workers;
+  int numWorkers;
+
+  // Chunks collected by EventBuffer_gather.
+  EventChunk** chunks;
+  int chunkCapacity;
+};
+typedef struct EventBuffer EventBuffer;
+
+// Set up one chunk for each Cilk worker.
+void EventBuffer_init(EventBuffer* buffer);
+
+void EventBuffer_destroy(EventBuffer* buffer);
+
+// Move the calling worker on to a new chunk.  Returns the new chunk.
+EventChunk* EventBuffer_nextChunk(WorkerEvents* worker);
+
+// Appends an event with the data (l1, l2, intersectionType) to the calling
+// worker's buffer.
+// Precondition: compareLines(l1, l2) < 0 must be true.
+static inline void EventBuffer_append(EventBuffer* buffer, Line* l1, Line* l2,
+                                      IntersectionType intersectionType) {
+  assert(compareLines(l1, l2) < 0);
+
+  int id = __cilkrts_get_worker_number();
+  assert(id >= 0 && id < buffer->numWorkers);
+  WorkerEvents* worker = &buffer->workers[id];
+  EventChunk* chunk = worker->current;
+  if (chunk->size == EVENT_CHUNK_SIZE) {
+    chunk = EventBuffer_nextChunk(worker);
+  }
+
+  IntersectionEvent* event = &chunk->events[chunk->size++];
+  event->key = IntersectionEvent_makeKey(l1, l2);
+  event->l1 = l1;
+  event->l2 = l2;
+  event->intersectionType = intersectionType;
+}
+
+// Appends every buffered event to list, in no particular order, and empties
+// the buffer, keeping its chunks for the next frame.  Must not run
+// concurrently with EventBuffer_append.
+void EventBuffer_gather(EventBuffer* buffer, IntersectionEventList* list);
+
+#endif  // EVENTBUFFER_H_
@@ -0,0 +1,75 @@
+/**
+ * fixed.h -- fixed-point coordinates for FIXED_POINT builds
+ *
+ * With FIXED_POINT defined (make FIXED=1), a line's endpoints are kept as
+ * 32-bit fixed-point numbers of 2^-FIXED_FRACTION_BITS box units, and so is
+ * how far they move in one time step.  Moves add integers, and the
+ * orientation tests of intersect() are computed on the integers with 64-bit
+ * intermediates, so they are exact.  The endpoints are mirrored in doubles,
+ * which hold them exactly, for the collision solver and the broad phase;
+ * velocities stay doubles.
+ **/
+
+#ifndef FIXED_H_
+#define FIXED_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#include "./vec.h"
+
+// Box coordinates lie in [.5, 1), so 30 fractional bits leave room for
+// values in [-2, 2).  Differences of coordinates in [0, 2) are below 2^31,
+// so a cross product of two differences fits in an int64_t.
+#define FIXED_FRACTION_BITS 30
+#define FIXED_ONE ((double) (1 << FIXED_FRACTION_BITS))
+
+typedef int32_t fixed_t;
+
+// A two-dimensional vector of fixed-point numbers.
+struct FixedVec {
+  fixed_t x;
+  fixed_t y;
+};
+typedef struct FixedVec FixedVec;
+
+// Round x to the nearest fixed-point number.
+static inline fixed_t Fixed_fromDouble(double x) {
+  return (fixed_t) lrint(x * FIXED_ONE);
+}
+
+static inline double Fixed_toDouble(fixed_t x) {
+  return x / FIXED_ONE;
+}
+
+static inline FixedVec FixedVec_fromVec(Vec vector) {
+  FixedVec fixed = { Fixed_fromDouble(vector.x), Fixed_fromDouble(vector.y) };
+  return fixed;
+}
+
+static inline Vec FixedVec_toVec(FixedVec fixed) {
+  return Vec_make(Fixed_toDouble(fixed.x), Fixed_toDouble(fixed.y));
+}
+
+static inline FixedVec FixedVec_add(FixedVec lhs, FixedVec rhs) {
+  FixedVec sum = { lhs.x + rhs.x, lhs.y + rhs.y };
+  return sum;
+}
+
+static inline FixedVec FixedVec_subtract(FixedVec lhs, FixedVec rhs) {
+  FixedVec difference = { lhs.x - rhs.x, lhs.y - rhs.y };
+  return difference;
+}
+
+// direction() of the points: the cross product of pk - pi and pj - pi,
+// computed exactly.
+static inline int64_t FixedVec_direction(FixedVec pi, FixedVec pj,
+                                         FixedVec pk) {
+  int64_t x1 = (int64_t) pk.x - pi.x;
+  int64_t y1 = (int64_t) pk.y - pi.y;
+  int64_t x2 = (int64_t) pj.x - pi.x;
+  int64_t y2 = (int64_t) pj.y - pi.y;
+  return x1 * y2 - x2 * y1;
+}
+
+#endif  // FIXED_H_
@@ -23,57 +23,174 @@
 #include "./intersection_detection.h"
 
 #include <assert.h>
+#include <stdint.h>
 
 #include "./line.h"
 #include "./vec.h"
 
+// The orientation tests of intersect() are computed on points of this
+// type.  In FIXED_POINT builds they are the lines' fixed-point endpoints,
+// and the tests are exact integer arithmetic.
+#ifdef FIXED_POINT
+typedef FixedVec Point;
+typedef int64_t Side;
+#else
+typedef Vec Point;
+typedef double Side;
+#endif
+
+static inline Point Point_fromVec(Vec vector) {
+#ifdef FIXED_POINT
+  return FixedVec_fromVec(vector);
+#else
+  return vector;
+#endif
+}
+
+// direction() on points.
+static inline Side Point_direction(Point pi, Point pj, Point pk) {
+#ifdef FIXED_POINT
+  return FixedVec_direction(pi, pj, pk);
+#else
+  return crossProduct(pk.x - pi.x, pk.y - pi.y, pj.x - pi.x, pj.y - pi.y);
+#endif
+}
+
+// onSegment() on points.
+static inline bool Point_onSegment(Point pi, Point pj, Point pk) {
+  return (((pi.x <= pk.x && pk.x <= pj.x) || (pj.x <= pk.x && pk.x <= pi.x))
+      && ((pi.y <= pk.y && pk.y <= pj.y) || (pj.y <= pk.y && pk.y <= pi.y)));
+}
+
+// pointInParallelogram() on points.
+static inline bool Point_inParallelogram(Point point, Point p1, Point p2,
+                                         Point p3, Point p4) {
+  Side d1 = Point_direction(p1, p2, point);
+  Side d2 = Point_direction(p3, p4, point);
+  Side d3 = Point_direction(p1, p3, point);
+  Side d4 = Point_direction(p2, p4, point);
+
+  if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0))
+      && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
+    return true;
+  }
+  return false;
+}
+
+// Check if two lines intersect, given d3 = direction(p1, p2, p3) and
+// d4 = direction(p1, p2, p4).
+static inline bool intersectLinesWithSides(Point p1, Point p2, Point p3,
+                                           Point p4, Side d3, Side d4) {
+  // Relative orientation
+  Side d1 = Point_direction(p3, p4, p1);
+  Side d2 = Point_direction(p3, p4, p2);
+
+  // If (p1, p2) and (p3, p4) straddle each other, the line segments must
+  // intersect.
+  if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0))
+      && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
+    return true;
+  }
+  if (d1 == 0 && Point_onSegment(p3, p4, p1)) {
+    return true;
+  }
+  if (d2 == 0 && Point_onSegment(p3, p4, p2)) {
+    return true;
+  }
+  if (d3 == 0 && Point_onSegment(p1, p2, p3)) {
+    return true;
+  }
+  if (d4 == 0 && Point_onSegment(p1, p2, p4)) {
+    return true;
+  }
+  return false;
+}
+
 // Detect if lines l1 and l2 will intersect between now and the next time step.
 IntersectionType intersect(Line *l1, Line *l2, double time) {
   assert(compareLines(l1, l2) < 0);
 
+  Point a1;  // l1's endpoints
+  Point a2;
+  Point b1;  // l2's endpoints
+  Point b2;
+  Point p1;
+  Point p2;
+
+#ifdef FIXED_POINT
+  // The lines' cached steps, computed for this time step, are exactly
+  // what they will move by.
+  a1 = l1->fp1;
+  a2 = l1->fp2;
+  b1 = l2->fp1;
+  b2 = l2->fp2;
+
+  // Get the parallelogram.
+  FixedVec move = FixedVec_subtract(l2->fstep, l1->fstep);
+  p1 = FixedVec_add(b1, move);
+  p2 = FixedVec_add(b2, move);
+#else
   Vec velocity;
-  Vec p1;
-  Vec p2;
-  Vec v1 = Vec_makeFromLine(*l1);
-  Vec v2 = Vec_makeFromLine(*l2);
+
+  a1 = l1->p1;
+  a2 = l1->p2;
+  b1 = l2->p1;
+  b2 = l2->p2;
 
   // Get relative velocity.
   velocity.x = l2->velocity.x - l1->velocity.x;
   velocity.y = l2->velocity.y - l1->velocity.y;
 
   // Get the parallelogram.
-   p1 = Vec_add(l2->p1, Vec_multiply(velocity, time));
-   p2 = Vec_add(l2->p2, Vec_multiply(velocity, time));
-  // p1.x = l2->p1.x + velocity.x;
-  // p1.y = l2->p1.y + velocity.y;
-  // p2.x = l2->p2.x + velocity.x;
-  // p2.y = l2->p2.y + velocity.y;
+  p1 = Vec_add(b1, Vec_multiply(velocity, time));
+  p2 = Vec_add(b2, Vec_multiply(velocity, time));
+#endif
+
+  // Separating axis test on the x and y axes: if l1 lies strictly on one
+  // side of the parallelogram, none of the tests below can succeed.
+  if (MAX(a1.x, a2.x) < MIN(MIN(b1.x, b2.x), MIN(p1.x, p2.x))
+      || MIN(a1.x, a2.x) > MAX(MAX(b1.x, b2.x), MAX(p1.x, p2.x))
+      || MAX(a1.y, a2.y) < MIN(MIN(b1.y, b2.y), MIN(p1.y, p2.y))
+      || MIN(a1.y, a2.y) > MAX(MAX(b1.y, b2.y), MAX(p1.y, p2.y))) {
+    return NO_INTERSECTION;
+  }
 
   int num_line_intersections = 0;
   bool top_intersected = false;
   bool bottom_intersected = false;
 
-  if (intersectLines(l1->p1, l1->p2, l2->p1, l2->p2)) {
-    return ALREADY_INTERSECTED;
-  }
-  if (intersectLines(l1->p1, l1->p2, p1, p2)) {
-    num_line_intersections++;
-  }
-  if (intersectLines(l1->p1, l1->p2, p1, l2->p1)) {
-    num_line_intersections++;
-    top_intersected = true;
-  }
-  if (intersectLines(l1->p1, l1->p2, p2, l2->p2)) {
-    num_line_intersections++;
-    bottom_intersected = true;
+  // Side of l1 each corner of the parallelogram is on, shared by the four
+  // segment tests.
+  Side side1 = Point_direction(a1, a2, b1);
+  Side side2 = Point_direction(a1, a2, b2);
+  Side side3 = Point_direction(a1, a2, p1);
+  Side side4 = Point_direction(a1, a2, p2);
+
+  // If all the corners are strictly on the same side, no edge can cross l1.
+  if (!((side1 > 0 && side2 > 0 && side3 > 0 && side4 > 0)
+        || (side1 < 0 && side2 < 0 && side3 < 0 && side4 < 0))) {
+    if (intersectLinesWithSides(a1, a2, b1, b2, side1, side2)) {
+      return ALREADY_INTERSECTED;
+    }
+    if (intersectLinesWithSides(a1, a2, p1, p2, side3, side4)) {
+      num_line_intersections++;
+    }
+    if (intersectLinesWithSides(a1, a2, p1, b1, side3, side1)) {
+      num_line_intersections++;
+      top_intersected = true;
+    }
+    if (intersectLinesWithSides(a1, a2, p2, b2, side4, side2)) {
+      num_line_intersections++;
+      bottom_intersected = true;
+    }
   }
 
   if (num_line_intersections == 2) {
     return L2_WITH_L1;
   }
 
-  if (pointInParallelogram(l1->p1, l2->p1, l2->p2, p1, p2)
-      && pointInParallelogram(l1->p2, l2->p1, l2->p2, p1, p2)) {
+  if (Point_inParallelogram(a1, b1, b2, p1, p2)
+      && Point_inParallelogram(a2, b1, b2, p1, p2)) {
     return L1_WITH_L2;
   }
 
@@ -81,7 +198,7 @@ IntersectionType intersect(Line *l1, Line *l2, double time) {
     return NO_INTERSECTION;
   }
 
-  double angle = Vec_angle(v1, v2);
+  double angle = Vec_angle(l1->dir, l2->dir);
 
   if (top_intersected) {
     if (angle < 0) {
@@ -102,47 +219,100 @@ IntersectionType intersect(Line *l1, Line *l2, double time) {
   return L1_WITH_L2;
 }
 
-// Check if a point is in the parallelogram.
-bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4) {
-  double d1 = direction(p1, p2, point);
-  double d2 = direction(p3, p4, point);
-  double d3 = direction(p1, p3, point);
-  double d4 = direction(p2, p4, point);
+// Time in [0, time] at which point p of a line (p, q), moving with velocity
+// vp, touches the segment (b1, b2) moving with velocity vb, or -1 if it
+// does not.  A point that already touches the segment hits it at time 0 if
+// it moves away from the side of the segment its line is on.
+static double pointContactTime(Vec p, Vec q, Vec vp, Vec b1, Vec b2, Vec vb,
+                               double time) {
+  Vec d = Vec_subtract(b2, b1);
+  Vec w = Vec_subtract(vp, vb);
+  Vec r = Vec_subtract(p, b1);
+  double tolerance = CONTACT_EPSILON * Vec_length(d);
 
-  if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0))
-      && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
-    return true;
+  // The signed distance of p from the segment's line changes linearly.
+  double s0 = Vec_crossProduct(d, r);
+  double ds = Vec_crossProduct(d, w);
+  if (ds == 0) {
+    return -1;
   }
-  return false;
+  double t;
+  if (fabs(s0) <= tolerance) {
+    double side = Vec_crossProduct(d, Vec_subtract(q, b1));
+    if (fabs(side) <= tolerance || (side > 0) == (ds > 0)) {
+      return -1;
+    }
+    t = 0;
+  } else {
+    t = -s0 / ds;
+    if (t <= 0 || t > time) {
+      return -1;
+    }
+  }
+
+  // Check that p hits the segment and not the rest of the line.  A point
+  // touching an end of the segment already, as where two lines share an
+  // endpoint, is left to the test of that end against p's line.
+  double u = Vec_dotProduct(Vec_add(r, Vec_multiply(w, t)), d);
+  double slack = t == 0 ? -tolerance : tolerance;
+  if (u < -slack || u > Vec_dotProduct(d, d) + slack) {
+    return -1;
+  }
+  return t;
 }
 
-// Check if two lines intersect.
-bool intersectLines(Vec p1, Vec p2, Vec p3, Vec p4) {
-  // Relative orientation
-  double d1 = direction(p3, p4, p1);
-  double d2 = direction(p3, p4, p2);
-  double d3 = direction(p1, p2, p3);
-  double d4 = direction(p1, p2, p4);
+IntersectionType contactTime(Line *l1, Line *l2, double time,
+                             double* contact) {
+  assert(compareLines(l1, l2) < 0);
 
-  // If (p1, p2) and (p3, p4) straddle each other, the line segments must
-  // intersect.
-  if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0))
-      && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))) {
-    return true;
+  IntersectionType type = NO_INTERSECTION;
+  double first = time;
+  double t;
+
+  t = pointContactTime(l1->p1, l1->p2, l1->velocity, l2->p1, l2->p2,
+                       l2->velocity, first);
+  if (t >= 0) {
+    first = t;
+    type = L1_WITH_L2;
   }
-  if (d1 == 0 && onSegment(p3, p4, p1)) {
-    return true;
+  t = pointContactTime(l1->p2, l1->p1, l1->velocity, l2->p1, l2->p2,
+                       l2->velocity, first);
+  if (t >= 0 && (type == NO_INTERSECTION || t < first - CONTACT_TIME_EPSILON)) {
+    first = t;
+    type = L1_WITH_L2;
   }
-  if (d2 == 0 && onSegment(p3, p4, p2)) {
-    return true;
+  t = pointContactTime(l2->p1, l2->p2, l2->velocity, l1->p1, l1->p2,
+                       l1->velocity, first);
+  if (t >= 0 && (type == NO_INTERSECTION || t < first - CONTACT_TIME_EPSILON)) {
+    first = t;
+    type = L2_WITH_L1;
   }
-  if (d3 == 0 && onSegment(p1, p2, p3)) {
-    return true;
-  }
-  if (d4 == 0 && onSegment(p1, p2, p4)) {
-    return true;
+  t = pointContactTime(l2->p2, l2->p1, l2->velocity, l1->p1, l1->p2,
+                       l1->velocity, first);
+  if (t >= 0 && (type == NO_INTERSECTION || t < first - CONTACT_TIME_EPSILON)) {
+    first = t;
+    type = L2_WITH_L1;
   }
-  return false;
+
+  *contact = first;
+  return type;
+}
+
+// Check if a point is in the parallelogram.
+bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4) {
+  return Point_inParallelogram(Point_fromVec(point), Point_fromVec(p1),
+                               Point_fromVec(p2), Point_fromVec(p3),
+                               Point_fromVec(p4));
+}
+
+// Check if two lines intersect.
+bool intersectLines(Vec p1, Vec p2, Vec p3, Vec p4) {
+  Point q1 = Point_fromVec(p1);
+  Point q2 = Point_fromVec(p2);
+  Point q3 = Point_fromVec(p3);
+  Point q4 = Point_fromVec(p4);
+  return intersectLinesWithSides(q1, q2, q3, q4, Point_direction(q1, q2, q3),
+                                 Point_direction(q1, q2, q4));
 }
 
 // Obtain the intersection point for two intersecting line segments.
@@ -157,14 +327,15 @@ Vec getIntersectionPoint(Vec p1, Vec p2, Vec p3, Vec p4) {
 
 // Check the direction of two lines (pi, pj) and (pi, pk).
 double direction(Vec pi, Vec pj, Vec pk) {
-  return crossProduct(pk.x - pi.x, pk.y - pi.y, pj.x - pi.x, pj.y - pi.y);
+  return Point_direction(Point_fromVec(pi), Point_fromVec(pj),
+                         Point_fromVec(pk));
 }
 
 // Check if a point pk is in the line segment (pi, pj).
 // pi, pj, and pk must be collinear.
 bool onSegment(Vec pi, Vec pj, Vec pk) {
-  return (((pi.x <= pk.x && pk.x <= pj.x) || (pj.x <= pk.x && pk.x <= pi.x))
-      && ((pi.y <= pk.y && pk.y <= pj.y) || (pj.y <= pk.y && pk.y <= pi.y)));
+  return Point_onSegment(Point_fromVec(pi), Point_fromVec(pj),
+                         Point_fromVec(pk));
 }
 
 // Calculate the cross product.
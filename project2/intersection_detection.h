@@ -34,9 +34,39 @@ typedef enum {
 } IntersectionType;
 
 // Detect if line l1 and l2 will be intersected in the next time step.
+// In FIXED_POINT builds the test is exact, on the lines' fixed-point
+// endpoints and steps, and time must be the step those were computed for.
 // Precondition: compareLines(l1, l2) < 0 must be true.
 IntersectionType intersect(Line *l1, Line *l2, double time);
 
+// Distance, in box units, within which a point touches a line.  Lines are
+// left touching after a contact, and must not collide again because of
+// rounding.
+#ifdef FIXED_POINT
+#define CONTACT_EPSILON (4 / FIXED_ONE)
+#else
+#define CONTACT_EPSILON 1e-14
+#endif
+
+// Endpoints hitting within this time of each other, as where two corners
+// meet, hit together; the first one tested wins, so that rounding does not
+// pick the endpoint.
+#define CONTACT_TIME_EPSILON 1e-12
+
+// Find the first time in [0, time] at which an endpoint of one line touches
+// the other line, assuming both keep their velocities.  An endpoint within
+// CONTACT_EPSILON of the other line touches it at time 0 if it moves into
+// it, and is ignored if it moves away.  Returns
+// NO_INTERSECTION if there is none; otherwise sets *contact to that time
+// and returns L1_WITH_L2 if an endpoint of l1 hits l2, L2_WITH_L1 if an
+// endpoint of l2 hits l1, l1's endpoints first on a tie.
+// Precondition: compareLines(l1, l2) < 0 must be true.
+IntersectionType contactTime(Line *l1, Line *l2, double time,
+                             double* contact);
+
+// The tests below round their arguments to fixed point in FIXED_POINT
+// builds.
+
 // Check if a point is in the parallelogram.
 bool pointInParallelogram(Vec point, Vec p1, Vec p2, Vec p3, Vec p4);
 
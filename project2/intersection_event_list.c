@@ -24,84 +24,112 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
-int IntersectionEventNode_compareData(IntersectionEventNode* node1,
-                                      IntersectionEventNode* node2) {
-  if (compareLines(node1->l1, node2->l1) < 0) {
-    return -1;
-  } else if (compareLines(node1->l1, node2->l1) == 0) {
-    if (compareLines(node1->l2, node2->l2) < 0) {
-      return -1;
-    } else if (compareLines(node1->l2, node2->l2) == 0) {
-      return 0;
-    } else {
-      return 1;
-    }
-  } else {
-    return 1;
-  }
-}
+#define EVENT_LIST_INITIAL_CAPACITY 64
 
-void IntersectionEventNode_swapData(IntersectionEventNode* node1,
-                                    IntersectionEventNode* node2) {
-  {
-    Line* temp = node1->l1;
-    node1->l1 = node2->l1;
-    node2->l1 = temp;
-  }
-  {
-    Line* temp = node1->l2;
-    node1->l2 = node2->l2;
-    node2->l2 = temp;
-  }
-  {
-    IntersectionType temp = node1->intersectionType;
-    node1->intersectionType = node2->intersectionType;
-    node2->intersectionType = temp;
-  }
-}
+// Lists at most this long are sorted by insertion sort instead.
+#define RADIX_SORT_CUTOFF 32
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
 
 IntersectionEventList IntersectionEventList_make() {
   IntersectionEventList intersectionEventList;
-  intersectionEventList.head = NULL;
-  intersectionEventList.tail = NULL;
+  intersectionEventList.events = NULL;
   intersectionEventList.size = 0;
+  intersectionEventList.capacity = 0;
   return intersectionEventList;
 }
 
-inline void IntersectionEventList_appendNode(
-    IntersectionEventList* intersectionEventList, Line* l1, Line* l2,
-    IntersectionType intersectionType) {
-  assert(compareLines(l1, l2) < 0);
-
-  IntersectionEventNode* newNode = malloc(sizeof(IntersectionEventNode));
-  if (newNode == NULL) {
+void IntersectionEventList_reserve(
+    IntersectionEventList* intersectionEventList, int capacity) {
+  if (capacity < EVENT_LIST_INITIAL_CAPACITY) {
+    capacity = EVENT_LIST_INITIAL_CAPACITY;
+  }
+  if (capacity <= intersectionEventList->capacity) {
     return;
   }
+  intersectionEventList->events =
+      realloc(intersectionEventList->events,
+              capacity * sizeof(IntersectionEvent));
+  assert(intersectionEventList->events != NULL);
+  intersectionEventList->capacity = capacity;
+}
 
-  newNode->l1 = l1;
-  newNode->l2 = l2;
-  newNode->intersectionType = intersectionType;
-  newNode->next = NULL;
-  if (intersectionEventList->head == NULL) {
-    intersectionEventList->head = newNode;
-  } else {
-    intersectionEventList->tail->next = newNode;
+static void insertion_sort(IntersectionEvent* events, int size) {
+  for (int i = 1; i < size; i++) {
+    IntersectionEvent e = events[i];
+    int j = i - 1;
+    while (j >= 0 && events[j].key > e.key) {
+      events[j + 1] = events[j];
+      j--;
+    }
+    events[j + 1] = e;
   }
-  intersectionEventList->tail = newNode;
-  intersectionEventList->size++;
 }
 
-void IntersectionEventList_deleteNodes(
-    IntersectionEventList* intersectionEventList) {
-  IntersectionEventNode* curNode = intersectionEventList->head;
-  IntersectionEventNode* nextNode = NULL;
-  while (curNode != NULL) {
-    nextNode = curNode->next;
-    free(curNode);
-    curNode = nextNode;
+void IntersectionEventList_sort(IntersectionEventList* intersectionEventList,
+                                IntersectionEventList* scratch) {
+  int size = intersectionEventList->size;
+  IntersectionEvent* src = intersectionEventList->events;
+
+  if (size <= RADIX_SORT_CUTOFF) {
+    insertion_sort(src, size);
+    return;
+  }
+
+  IntersectionEventList_reserve(scratch, intersectionEventList->capacity);
+  IntersectionEvent* dst = scratch->events;
+
+  // Histogram every digit in a single pass over the keys.
+  int count[RADIX_PASSES][RADIX_BUCKETS];
+  memset(count, 0, sizeof(count));
+  for (int i = 0; i < size; i++) {
+    uint64_t key = src[i].key;
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+      count[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+  }
+
+  for (int pass = 0; pass < RADIX_PASSES; pass++) {
+    int shift = pass * RADIX_BITS;
+    int* c = count[pass];
+
+    // Every key has the same digit here, so this pass would not move
+    // anything.  This skips the unused high bits of the line IDs.
+    if (c[(src[0].key >> shift) & (RADIX_BUCKETS - 1)] == size) {
+      continue;
+    }
+
+    int offset = 0;
+    for (int b = 0; b < RADIX_BUCKETS; b++) {
+      int t = c[b];
+      c[b] = offset;
+      offset += t;
+    }
+    for (int i = 0; i < size; i++) {
+      dst[c[(src[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+    }
+
+    IntersectionEvent* t = src;
+    src = dst;
+    dst = t;
+  }
+
+  if (src != intersectionEventList->events) {
+    memcpy(intersectionEventList->events, src,
+           size * sizeof(IntersectionEvent));
   }
-  intersectionEventList->head = NULL;
-  intersectionEventList->tail = NULL;
+}
+
+void IntersectionEventList_clear(IntersectionEventList* intersectionEventList) {
+  intersectionEventList->size = 0;
+}
+
+void IntersectionEventList_free(IntersectionEventList* intersectionEventList) {
+  free(intersectionEventList->events);
+  intersectionEventList->events = NULL;
   intersectionEventList->size = 0;
+  intersectionEventList->capacity = 0;
 }
@@ -23,47 +23,66 @@
 #ifndef INTERSECTIONEVENTLIST_H_
 #define INTERSECTIONEVENTLIST_H_
 
+#include <assert.h>
+#include <stdint.h>
+
 #include "./line.h"
 #include "./intersection_detection.h"
 
-struct IntersectionEventNode {
-  // This IntersectionEventNode does not own these Line* lines.
+struct IntersectionEvent {
+  // Sort key: l1's line ID in the high 32 bits, l2's line ID in the low 32.
+  uint64_t key;
+  // This IntersectionEvent does not own these Line* lines.
   Line* l1;
   Line* l2;
   IntersectionType intersectionType;
-  struct IntersectionEventNode* next;
 };
-typedef struct IntersectionEventNode IntersectionEventNode;
+typedef struct IntersectionEvent IntersectionEvent;
 
-// Compares the nodes by l1's line ID, then l1's line ID.
-// -1 <=> node1 ordered before node2
-//  0 <=> node1 ordered the same as node2
-//  1 <=> node1 ordered after node2
-int IntersectionEventNode_compareData(IntersectionEventNode* node1,
-                                      IntersectionEventNode* node2);
+// Packs the IDs of l1 and l2 into the 64-bit key events are sorted by.
+static inline uint64_t IntersectionEvent_makeKey(Line* l1, Line* l2) {
+  return ((uint64_t) l1->id << 32) | l2->id;
+}
 
-// Swaps the node1's and node2's data (l1, l2, intersectionType).
-void IntersectionEventNode_swapData(IntersectionEventNode* node1,
-                                    IntersectionEventNode* node2);
+// Compares the events by l1's line ID, then l2's line ID.
+// -1 <=> event1 ordered before event2
+//  0 <=> event1 ordered the same as event2
+//  1 <=> event1 ordered after event2
+static inline int IntersectionEvent_compareData(IntersectionEvent* event1,
+                                                IntersectionEvent* event2) {
+  if (event1->key < event2->key) {
+    return -1;
+  } else if (event1->key == event2->key) {
+    return 0;
+  } else {
+    return 1;
+  }
+}
 
+// A growable, contiguous buffer of intersection events.
 struct IntersectionEventList {
-  IntersectionEventNode* head;
-  IntersectionEventNode* tail;
+  IntersectionEvent* events;
   int size;
+  int capacity;
 };
 typedef struct IntersectionEventList IntersectionEventList;
 
 // Returns an empty list.
 IntersectionEventList IntersectionEventList_make();
 
-// Appends a new node to the list with the data (l1, l2, intersectionType).
-// Precondition: compareLines(l1, l2) < 0 must be true.
-void IntersectionEventList_appendNode(
-    IntersectionEventList* intersectionEventList, Line* l1, Line* l2,
-    IntersectionType intersectionType);
+// Makes sure the list can hold at least capacity events.
+void IntersectionEventList_reserve(
+    IntersectionEventList* intersectionEventList, int capacity);
+
+// Sorts the events by key with an LSD radix sort.  The buffer of scratch is
+// used as temporary storage, and grown if needed.
+void IntersectionEventList_sort(IntersectionEventList* intersectionEventList,
+                                IntersectionEventList* scratch);
+
+// Removes all the events in the list, keeping its storage for reuse.
+void IntersectionEventList_clear(IntersectionEventList* intersectionEventList);
 
-// Deletes all the nodes in the list.
-void IntersectionEventList_deleteNodes(
-    IntersectionEventList* intersectionEventList);
+// Releases the storage of the list.
+void IntersectionEventList_free(IntersectionEventList* intersectionEventList);
 
 #endif  // INTERSECTIONEVENTLIST_H_
@@ -29,6 +29,7 @@
 
 #include "./graphic_stuff.h"
 #include "./vec.h"
+#include "./fixed.h"
 
 // Lines' coordinates are stored in a box with these bounds
 // We choose box coordinates in [.5, 1) to simulate fixed
@@ -62,12 +63,31 @@ struct Line {
   // The line's current velocity, in units of pixels per time step.
   Vec velocity;
 
+  // p1 - p2, cached by Line_update_shape.
+  Vec dir;
+
+#ifdef FIXED_POINT
+  // The endpoints in fixed point (see fixed.h); p1 and p2 hold the same
+  // values.
+  FixedVec fp1;
+  FixedVec fp2;
+  // How far the endpoints move in one time step, cached by
+  // Line_update_step.
+  FixedVec fstep;
+#endif
+
   Color color;  // The line's color.
 
   unsigned int id;  // Unique line ID.
 };
 typedef struct Line Line;
 
+// Returns a vector parallel to the provided Line.  The direction of the
+// vector is unspecified.
+static inline Vec Vec_makeFromLine(struct Line line) {
+  return Vec_subtract(line.p1, line.p2);
+}
+
 // Compares the lines by line ID.
 // -1 <=> line1 ordered before line2
 //  0 <=> line1 ordered the same as line2
@@ -82,6 +102,54 @@ static inline int compareLines(Line *line1, Line *line2) {
   }
 }
 
+// Recompute the bounding box (sw, ne) of the area the line sweeps over
+// during the next sweep time units.
+static inline void Line_update_box(Line* line, double sweep) {
+  line->sw.x = MIN(line->p1.x, line->p2.x) + MIN(line->velocity.x * sweep, 0);
+  line->sw.y = MIN(line->p1.y, line->p2.y) + MIN(line->velocity.y * sweep, 0);
+  line->ne.x = MAX(line->p1.x, line->p2.x) + MAX(line->velocity.x * sweep, 0);
+  line->ne.y = MAX(line->p1.y, line->p2.y) + MAX(line->velocity.y * sweep, 0);
+}
+
+// Recompute the cached shape of the line after its endpoints moved.
+// The face normal and angle are only needed for the few pairs that collide,
+// so they are derived from dir on demand.
+static inline void Line_update_shape(Line* line) {
+  line->dir.x = line->p1.x - line->p2.x;
+  line->dir.y = line->p1.y - line->p2.y;
+}
+
+// In FIXED_POINT builds, round the line's endpoints to fixed-point numbers
+// (see fixed.h), which become its position.  Does nothing otherwise.
+static inline void Line_snap(Line* line) {
+#ifdef FIXED_POINT
+  line->fp1 = FixedVec_fromVec(line->p1);
+  line->fp2 = FixedVec_fromVec(line->p2);
+  line->p1 = FixedVec_toVec(line->fp1);
+  line->p2 = FixedVec_toVec(line->fp2);
+#endif
+}
+
+// In FIXED_POINT builds, recompute how far the line moves in a time step of
+// timeStep at its velocity.  Does nothing otherwise.
+static inline void Line_update_step(Line* line, double timeStep) {
+#ifdef FIXED_POINT
+  line->fstep = FixedVec_fromVec(Vec_multiply(line->velocity, timeStep));
+#endif
+}
+
+#ifdef FIXED_POINT
+// Move the fixed-point endpoints by delta, rounded once to fixed point, and
+// copy them to p1 and p2.
+static inline void Line_moveFixed(Line* line, Vec delta) {
+  FixedVec move = FixedVec_fromVec(delta);
+  line->fp1 = FixedVec_add(line->fp1, move);
+  line->fp2 = FixedVec_add(line->fp2, move);
+  line->p1 = FixedVec_toVec(line->fp1);
+  line->p2 = FixedVec_toVec(line->fp2);
+}
+#endif
+
 // Convert graphical window coordinates to box coordinates.
 static inline void windowToBox(box_dimension *xout, box_dimension *yout,
                                window_dimension x, window_dimension y) {
@@ -28,8 +28,13 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include "./autotune.h"
+#include "./bvh.h"
+#include "./checkpoint.h"
 #include "./graphic_stuff.h"
 #include "./line.h"
+#include "./quadtree.h"
+#include "./scene.h"
 
 static char* LineDemo_input_file_path;
 
@@ -45,63 +50,121 @@ LineDemo* LineDemo_new() {
 
   lineDemo->count = 0;
   lineDemo->numFrames = 0;
+  lineDemo->statsInterval = 0;
+  lineDemo->checkpointInterval = 0;
+  lineDemo->checkpointPath = NULL;
   lineDemo->collisionWorld = NULL;
   return lineDemo;
 }
 
 void LineDemo_delete(LineDemo* lineDemo) {
+  if (CollisionWorld_finishSave(lineDemo->collisionWorld) != 0) {
+    fprintf(stderr, "Could not write checkpoint (%s)\n",
+            lineDemo->checkpointPath);
+  }
   CollisionWorld_delete(lineDemo->collisionWorld);
   free(lineDemo);
 }
 
-// Read in lines from line.in and add them into collision world for simulation.
+// Read in lines from the input file (text or binary scene) and add them
+// into collision world for simulation.
 void LineDemo_createLines(LineDemo* lineDemo) {
-  unsigned int lineId = 0;
-  unsigned int numOfLines;
-  window_dimension px1;
-  window_dimension py1;
-  window_dimension px2;
-  window_dimension py2;
-  window_dimension vx;
-  window_dimension vy;
-  int isGray;
-  FILE *fin;
-  fin = fopen(LineDemo_input_file_path, "r");
-  if (fin == NULL) {
-    fprintf(stderr, "Input file not found (%s)\n", LineDemo_input_file_path);
+  if (LineDemo_loadScene(lineDemo, LineDemo_input_file_path) != 0) {
+    fprintf(stderr, "Input file not found or invalid (%s)\n",
+            LineDemo_input_file_path);
     exit(1);
   }
+}
+
+int LineDemo_loadScene(LineDemo* lineDemo, const char* path) {
+  unsigned int numOfLines;
+  Line* lines;
+  if (Scene_isBinary(path)) {
+    lines = Scene_readBinary(path, &numOfLines);
+  } else {
+    lines = Scene_readText(path, &numOfLines);
+  }
+  if (lines == NULL) {
+    return -1;
+  }
 
-  fscanf(fin, "%d\n", &numOfLines);
-  lineDemo->collisionWorld = CollisionWorld_new(numOfLines);
+  // transfer ownership of lines to collisionWorld
+  lineDemo->collisionWorld = CollisionWorld_new(MAX(numOfLines, 1));
+  CollisionWorld_addLines(lineDemo->collisionWorld, lines, numOfLines);
+  return 0;
+}
 
-  while (EOF
-      != fscanf(fin, "(%lf, %lf), (%lf, %lf), %lf, %lf, %d\n", &px1, &py1, &px2,
-                &py2, &vx, &vy, &isGray)) {
-    Line *line = malloc(sizeof(Line));
+void LineDemo_setNumFrames(LineDemo* lineDemo, const unsigned int numFrames) {
+  lineDemo->numFrames = numFrames;
+}
 
-    // convert window coordinates to box coordinates
-    windowToBox(&line->p1.x, &line->p1.y, px1, py1);
-    windowToBox(&line->p2.x, &line->p2.y, px2, py2);
+void LineDemo_setTimeStep(LineDemo* lineDemo, const double timeStep) {
+  CollisionWorld_setTimeStep(lineDemo->collisionWorld, timeStep);
+}
 
-    // convert window velocity to box velocity
-    velocityWindowToBox(&line->velocity.x, &line->velocity.y, vx, vy);
+void LineDemo_setEventDriven(LineDemo* lineDemo, const bool eventDriven) {
+  lineDemo->collisionWorld->eventDriven = eventDriven;
+}
 
-    // store color
-    line->color = (Color) isGray;
+void LineDemo_setBroadPhase(LineDemo* lineDemo, const BroadPhase broadPhase) {
+  CollisionWorld_setBroadPhase(lineDemo->collisionWorld, broadPhase);
+}
 
-    // store line ID
-    line->id = lineId;
-    lineId++;
+void LineDemo_setPairCache(LineDemo* lineDemo, const bool enabled) {
+  CollisionWorld_setPairCache(lineDemo->collisionWorld, enabled);
+}
 
-    // transfer ownership of line to collisionWorld
-    CollisionWorld_addLine(lineDemo->collisionWorld, line);
+void LineDemo_autotune(LineDemo* lineDemo, const unsigned int frames) {
+  AutotuneResult result = Autotune_quadtree(lineDemo->collisionWorld, frames);
+  if (result.trials == 0) {
+    printf("Autotuning only applies to the quadtree broad phases\n");
+    return;
   }
-  fclose(fin);
+  printf("Autotuned over %u frames (%d trials): max lines %d, max depth %d, "
+         "parallel depth %d, %.2fx the speed of the defaults\n",
+         frames, result.trials, result.params.maxLines,
+         result.params.maxDepth, result.params.parallelDepth,
+         result.defaultSeconds / result.seconds);
 }
 
-void LineDemo_setNumFrames(LineDemo* lineDemo, const unsigned int numFrames) {
-  lineDemo->numFrames = numFrames;
+void LineDemo_enableProfile(LineDemo* lineDemo) {
+  CollisionWorld* collisionWorld = lineDemo->collisionWorld;
+  if (collisionWorld->profile == NULL) {
+    collisionWorld->profile = Profile_new();
+  }
+}
+
+int LineDemo_writeProfile(LineDemo* lineDemo, const char* path) {
+  Profile* profile = lineDemo->collisionWorld->profile;
+  FILE* out = fopen(path, "w");
+  if (profile == NULL || out == NULL) {
+    if (out != NULL) {
+      fclose(out);
+    }
+    return -1;
+  }
+  Profile_writeCSV(profile, out);
+  return fclose(out) == 0 ? 0 : -1;
+}
+
+void LineDemo_setStatsInterval(LineDemo* lineDemo,
+                               const unsigned int statsInterval) {
+  lineDemo->statsInterval = statsInterval;
+}
+
+void LineDemo_setCheckpoint(LineDemo* lineDemo, const unsigned int interval,
+                            char* path) {
+  lineDemo->checkpointInterval = interval;
+  lineDemo->checkpointPath = path;
+}
+
+int LineDemo_resume(LineDemo* lineDemo, const char* path) {
+  uint64_t frame;
+  if (CollisionWorld_load(lineDemo->collisionWorld, path, &frame) != 0) {
+    return -1;
+  }
+  lineDemo->count = frame;
+  return 0;
 }
 
 void LineDemo_initLine(LineDemo* lineDemo) {
@@ -124,10 +187,31 @@ unsigned int LineDemo_getNumLineLineCollisions(LineDemo* lineDemo) {
   return CollisionWorld_getNumLineLineCollisions(lineDemo->collisionWorld);
 }
 
+uint64_t LineDemo_getNumCandidatePairs(LineDemo* lineDemo) {
+  return CollisionWorld_getNumCandidatePairs(lineDemo->collisionWorld);
+}
+
 // The main simulation loop
 bool LineDemo_update(LineDemo* lineDemo) {
   lineDemo->count++;
   CollisionWorld_updateLines(lineDemo->collisionWorld);
+  if (lineDemo->statsInterval != 0
+      && lineDemo->count % lineDemo->statsInterval == 0) {
+    if (lineDemo->collisionWorld->broadPhase == BROAD_PHASE_BVH) {
+      BVH_print_stats(lineDemo->collisionWorld->bvh, stdout);
+    } else {
+      QuadTree_print_stats(lineDemo->collisionWorld->qt, stdout);
+    }
+  }
+  if (lineDemo->checkpointInterval != 0
+      && lineDemo->count % lineDemo->checkpointInterval == 0) {
+    if (CollisionWorld_saveAsync(lineDemo->collisionWorld,
+                                 lineDemo->checkpointPath,
+                                 lineDemo->count) != 0) {
+      fprintf(stderr, "Could not write checkpoint (%s)\n",
+              lineDemo->checkpointPath);
+    }
+  }
   if (lineDemo->count > lineDemo->numFrames) {
     return false;
   }
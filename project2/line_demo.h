@@ -34,6 +34,13 @@ struct LineDemo {
   // Number of frames to compute
   unsigned int numFrames;
 
+  // Print broad-phase statistics every statsInterval frames (0 = never)
+  unsigned int statsInterval;
+
+  // Checkpoint to checkpointPath every checkpointInterval frames (0 = never)
+  unsigned int checkpointInterval;
+  char* checkpointPath;
+
   // Objects for line simulation
   CollisionWorld* collisionWorld;
 };
@@ -45,9 +52,54 @@ void LineDemo_delete(LineDemo* lineDemo);
 // Add lines for line simulation at beginning.
 void LineDemo_createLines(LineDemo* lineDemo);
 
+// Create the collision world from the scene in path instead of the input
+// file.  Returns 0 on success.
+int LineDemo_loadScene(LineDemo* lineDemo, const char* path);
+
 // Set number of frames to compute.
 void LineDemo_setNumFrames(LineDemo* lineDemo, const unsigned int numFrames);
 
+// Set the simulated time per frame.  Must be called after LineDemo_initLine.
+void LineDemo_setTimeStep(LineDemo* lineDemo, const double timeStep);
+
+// Resolve collisions in time order within each frame (see continuous.h).
+// Must be called after LineDemo_initLine.
+void LineDemo_setEventDriven(LineDemo* lineDemo, const bool eventDriven);
+
+// Use broadPhase to find candidate pairs.  Must be called after
+// LineDemo_initLine.
+void LineDemo_setBroadPhase(LineDemo* lineDemo, const BroadPhase broadPhase);
+
+// Skip the pair tests the pair cache shows are not needed (see
+// pair_cache.h).  Must be called after LineDemo_initLine.
+void LineDemo_setPairCache(LineDemo* lineDemo, const bool enabled);
+
+// Record per-phase timings of every frame (see profile.h).  Must be called
+// after LineDemo_initLine.
+void LineDemo_enableProfile(LineDemo* lineDemo);
+
+// Write the per-phase timings recorded so far as CSV to path.
+// Returns 0 on success.
+int LineDemo_writeProfile(LineDemo* lineDemo, const char* path);
+
+// Set how often broad-phase statistics are printed (0 = never).
+void LineDemo_setStatsInterval(LineDemo* lineDemo,
+                               const unsigned int statsInterval);
+
+// Checkpoint the simulation to path every interval frames (0 = never).
+void LineDemo_setCheckpoint(LineDemo* lineDemo, const unsigned int interval,
+                            char* path);
+
+// Continue the simulation from a checkpoint.  Must be called after
+// LineDemo_initLine with the scene the checkpoint was taken from.
+// Returns 0 on success.
+int LineDemo_resume(LineDemo* lineDemo, const char* path);
+
+// Pick the quadtree parameters by timing the next frames frames under
+// different settings (see autotune.h) and print the choice.  Must be called
+// after LineDemo_setBroadPhase, and after LineDemo_resume if resuming.
+void LineDemo_autotune(LineDemo* lineDemo, const unsigned int frames);
+
 // Initialize line simulation.
 void LineDemo_initLine(LineDemo* lineDemo);
 
@@ -63,6 +115,9 @@ unsigned int LineDemo_getNumLineWallCollisions(LineDemo* lineDemo);
 // Get number of line-line collisions.
 unsigned int LineDemo_getNumLineLineCollisions(LineDemo* lineDemo);
 
+// Get number of line pairs tested for intersection.
+uint64_t LineDemo_getNumCandidatePairs(LineDemo* lineDemo);
+
 // Line simulation update function.
 bool LineDemo_update(LineDemo* lineDemo);
 
@@ -0,0 +1,99 @@
+/**
+ * pair_cache.c -- skip the pair test for pairs that stay apart
+ **/
+
+#include "./pair_cache.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The table holds at least PAIR_CACHE_MIN_CAPACITY entries, and at most
+// PAIR_CACHE_MAX_CAPACITY, which bounds it to 64 MiB.
+#define PAIR_CACHE_MIN_CAPACITY 1024
+#define PAIR_CACHE_MAX_CAPACITY (1 << 22)
+
+void PairCache_init(PairCache* cache, unsigned int numLines) {
+  cache->enabled = false;
+  cache->entries = NULL;
+  cache->capacity = 0;
+  cache->travel = calloc(numLines, sizeof(double));
+  assert(cache->travel != NULL);
+  cache->numLines = numLines;
+  cache->frame = 0;
+}
+
+void PairCache_destroy(PairCache* cache) {
+  free(cache->entries);
+  free(cache->travel);
+}
+
+void PairCache_setEnabled(PairCache* cache, bool enabled) {
+  cache->enabled = enabled;
+  if (!enabled) {
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->capacity = 0;
+  }
+}
+
+void PairCache_clear(PairCache* cache) {
+  if (cache->entries != NULL) {
+    // An all-ones key is PAIR_CACHE_EMPTY.
+    memset(cache->entries, 0xff, cache->capacity * sizeof(PairCacheEntry));
+  }
+  // No entry refers to the odometers any more.
+  memset(cache->travel, 0, cache->numLines * sizeof(double));
+}
+
+void PairCache_endFrame(PairCache* cache, uint64_t candidatePairs) {
+  cache->frame++;
+  if (!cache->enabled) {
+    return;
+  }
+
+  // Keep the table at most half full.
+  int capacity = PAIR_CACHE_MIN_CAPACITY;
+  while (capacity < PAIR_CACHE_MAX_CAPACITY && capacity < 2 * candidatePairs) {
+    capacity *= 2;
+  }
+  if (capacity > cache->capacity) {
+    free(cache->entries);
+    cache->entries = malloc(capacity * sizeof(PairCacheEntry));
+    assert(cache->entries != NULL);
+    cache->capacity = capacity;
+    PairCache_clear(cache);
+  } else if (cache->frame % PAIR_CACHE_CLEAR_INTERVAL == 0) {
+    PairCache_clear(cache);
+  }
+}
+
+// Squared distance from p to the segment (a, b).
+static inline double pointSegmentDistance2(Vec p, Vec a, Vec b) {
+  Vec d = Vec_subtract(b, a);
+  Vec r = Vec_subtract(p, a);
+  double length2 = Vec_dotProduct(d, d);
+  double u = length2 > 0 ? Vec_dotProduct(r, d) / length2 : 0;
+  u = MIN(MAX(u, 0), 1);
+  Vec q = Vec_subtract(r, Vec_multiply(d, u));
+  return Vec_dotProduct(q, q);
+}
+
+void PairCache_record(PairCache* cache, PairCacheEntry* entry, Line* l1,
+                      Line* l2, IntersectionType intersectionType) {
+  if (intersectionType != NO_INTERSECTION) {
+    entry->reach = 0;
+    return;
+  }
+
+  // The segments do not cross, so the closest points include an endpoint.
+  double d1 = pointSegmentDistance2(l1->p1, l2->p1, l2->p2);
+  double d2 = pointSegmentDistance2(l1->p2, l2->p1, l2->p2);
+  double d3 = pointSegmentDistance2(l2->p1, l1->p1, l1->p2);
+  double d4 = pointSegmentDistance2(l2->p2, l1->p1, l1->p2);
+  double gap = sqrt(MIN(MIN(d1, d2), MIN(d3, d4))) - PAIR_CACHE_SLACK;
+  if (isnan(d1 + d2 + d3 + d4)) {
+    gap = 0;
+  }
+  entry->reach = gap + cache->travel[l1->id] + cache->travel[l2->id];
+}
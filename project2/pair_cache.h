@@ -0,0 +1,152 @@
+/**
+ * pair_cache.h -- skip the pair test for pairs that stay apart
+ *
+ * Most candidate pairs overlap in their swept boxes frame after frame
+ * without ever colliding.  When intersect() finds that a pair does not
+ * collide, the cache records how far apart the two lines are.  A line
+ * translates without turning, and it moves at most |velocity| * timeStep
+ * per frame whatever collisions change its velocity, so the pair cannot
+ * meet until the distance the two lines have travelled since then, plus
+ * their relative motion in the frame being tested, adds up to that gap.
+ * Until then the pair is not tested again.
+ *
+ * Each line keeps an odometer of the distance it has travelled, and an
+ * entry keeps reach = gap + the two odometers when the gap was measured.
+ * The pair is skipped while the two odometers now, plus the relative
+ * motion in this frame, stay below reach.  The odometers are reset
+ * whenever the table is emptied, so they stay small enough for
+ * PAIR_CACHE_ROUNDING and PAIR_CACHE_SLACK to be far above their rounding.
+ *
+ * The entries live in an open-addressing table keyed by the two line IDs.
+ * Every pair is tested at most once per frame, so an entry is only touched
+ * by one worker in a frame, and inserting a key is a single compare and
+ * swap.  PairCache_endFrame grows the table with the number of candidate
+ * pairs, and empties it now and then to get rid of the pairs that are no
+ * longer candidates.
+ **/
+
+#ifndef PAIRCACHE_H_
+#define PAIRCACHE_H_
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./fixed.h"
+#include "./intersection_detection.h"
+#include "./line.h"
+
+// Bound on how far a line may move per frame besides velocity * timeStep,
+// because its endpoints are rounded.
+#ifdef FIXED_POINT
+#define PAIR_CACHE_ROUNDING (2 / FIXED_ONE)
+#else
+#define PAIR_CACHE_ROUNDING 1e-15
+#endif
+
+// Margin taken off every gap for the rounding error in measuring it.
+#define PAIR_CACHE_SLACK 1e-12
+
+#define PAIR_CACHE_EMPTY UINT64_MAX
+// Slots a lookup probes before giving up on a pair.
+#define PAIR_CACHE_PROBES 16
+// Frames between two clears of the table.
+#define PAIR_CACHE_CLEAR_INTERVAL 64
+
+struct PairCacheEntry {
+  uint64_t key;
+  double reach;
+};
+typedef struct PairCacheEntry PairCacheEntry;
+
+struct PairCache {
+  bool enabled;
+
+  // Table of capacity entries, a power of 2, or NULL.
+  PairCacheEntry* entries;
+  int capacity;
+
+  // Distance travelled by each line since the table was last emptied,
+  // indexed by line ID.
+  double* travel;
+  unsigned int numLines;
+
+  unsigned int frame;
+};
+typedef struct PairCache PairCache;
+
+// Set up an empty, disabled cache for up to numLines lines.
+void PairCache_init(PairCache* cache, unsigned int numLines);
+
+// Start or stop caching pairs.
+void PairCache_setEnabled(PairCache* cache, bool enabled);
+
+void PairCache_destroy(PairCache* cache);
+
+// Forget every entry and reset the odometers, for when the lines have been
+// moved other than by CollisionWorld_advanceLines.
+void PairCache_clear(PairCache* cache);
+
+// Size the table for about candidatePairs pairs per frame, or empty it
+// every PAIR_CACHE_CLEAR_INTERVAL frames.  Must not run concurrently with
+// PairCache_find.
+void PairCache_endFrame(PairCache* cache, uint64_t candidatePairs);
+
+// Returns the entry of the pair (l1, l2), inserting an empty one if there
+// is none, or NULL if the cache is disabled or has no room for it.
+// Precondition: compareLines(l1, l2) < 0 must be true.
+static inline PairCacheEntry* PairCache_find(PairCache* cache, Line* l1,
+                                             Line* l2) {
+  if (cache->entries == NULL) {
+    return NULL;
+  }
+  uint64_t key = ((uint64_t) l1->id << 32) | l2->id;
+  unsigned int mask = cache->capacity - 1;
+  unsigned int slot = ((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+  for (int probe = 0; probe < PAIR_CACHE_PROBES; probe++) {
+    PairCacheEntry* entry = &cache->entries[slot];
+    uint64_t found = __atomic_load_n(&entry->key, __ATOMIC_RELAXED);
+    if (found == PAIR_CACHE_EMPTY) {
+      found = __sync_val_compare_and_swap(&entry->key, PAIR_CACHE_EMPTY,
+                                          key);
+      if (found == PAIR_CACHE_EMPTY) {
+        entry->reach = 0;
+        return entry;
+      }
+    }
+    if (found == key) {
+      return entry;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return NULL;
+}
+
+// Returns true if the pair of entry cannot collide in the next time units.
+static inline bool PairCache_separated(PairCache* cache,
+                                       PairCacheEntry* entry, Line* l1,
+                                       Line* l2, double time) {
+  double margin = entry->reach - cache->travel[l1->id]
+                  - cache->travel[l2->id];
+  if (!(margin > 0)) {
+    return false;
+  }
+  double dx = (l2->velocity.x - l1->velocity.x) * time;
+  double dy = (l2->velocity.y - l1->velocity.y) * time;
+  return dx * dx + dy * dy < margin * margin;
+}
+
+// Record the outcome of testing the pair of entry in this frame.
+void PairCache_record(PairCache* cache, PairCacheEntry* entry, Line* l1,
+                      Line* l2, IntersectionType intersectionType);
+
+// Add the distance line covers moving for time to its odometer.
+static inline void PairCache_move(PairCache* cache, Line* line, double time) {
+  if (!cache->enabled) {
+    return;
+  }
+  cache->travel[line->id] += Vec_length(line->velocity) * time
+                             + PAIR_CACHE_ROUNDING;
+}
+
+#endif  // PAIRCACHE_H_
@@ -0,0 +1,147 @@
+/**
+ * profile.c -- per-phase frame profiler for CollisionWorld
+ **/
+
+#include "./profile.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cilk/cilk_api.h>
+
+#include "./fasttime.h"
+
+static const char* phaseNames[NUM_PHASES] = {
+  "quadtree_us", "pairs_us", "sort_us", "resolve_us", "advance_us"
+};
+
+uint64_t Profile_nanoseconds() {
+  fasttime_t now = gettime();
+  return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+Profile* Profile_new() {
+  Profile* profile = malloc(sizeof(Profile));
+  if (profile == NULL) {
+    return NULL;
+  }
+  profile->frames = NULL;
+  profile->numFrames = 0;
+  profile->capacity = 0;
+  memset(&profile->current, 0, sizeof(FrameProfile));
+  profile->startCycles = Profile_cycles();
+  profile->startSeconds = Profile_nanoseconds() * 1e-9;
+
+  // Threads that are not Cilk workers but enter Cilk code get worker
+  // numbers past nworkers, so count them as well.
+  profile->numWorkerCounters = __cilkrts_get_total_workers() + 1;
+  profile->workerCounters = calloc(profile->numWorkerCounters,
+                                   sizeof(WorkerCounter));
+  if (profile->workerCounters == NULL) {
+    free(profile);
+    return NULL;
+  }
+  return profile;
+}
+
+void Profile_delete(Profile* profile) {
+  free(profile->workerCounters);
+  free(profile->frames);
+  free(profile);
+}
+
+void Profile_startFrame(Profile* profile) {
+  memset(&profile->current, 0, sizeof(FrameProfile));
+  profile->mark = Profile_cycles();
+}
+
+// The calling worker's counter, or NULL if it must use the shared one.
+static inline WorkerCounter* Profile_workerCounter(Profile* profile) {
+  int worker = __cilkrts_get_worker_number();
+  if (worker < 0 || worker >= profile->numWorkerCounters - 1) {
+    return NULL;
+  }
+  return &profile->workerCounters[worker];
+}
+
+void Profile_countBBoxTests(Profile* profile, uint64_t n) {
+  if (profile == NULL) {
+    return;
+  }
+  WorkerCounter* counter = Profile_workerCounter(profile);
+  if (counter != NULL) {
+    counter->bboxTests += n;
+  } else {
+    __atomic_fetch_add(&profile->workerCounters[
+                           profile->numWorkerCounters - 1].bboxTests,
+                       n, __ATOMIC_RELAXED);
+  }
+}
+
+void Profile_countCachedPairs(Profile* profile, uint64_t n) {
+  if (profile == NULL) {
+    return;
+  }
+  WorkerCounter* counter = Profile_workerCounter(profile);
+  if (counter != NULL) {
+    counter->cachedPairs += n;
+  } else {
+    __atomic_fetch_add(&profile->workerCounters[
+                           profile->numWorkerCounters - 1].cachedPairs,
+                       n, __ATOMIC_RELAXED);
+  }
+}
+
+void Profile_endFrame(Profile* profile, uint64_t candidatePairs,
+                      unsigned int collisions, int treeDepth) {
+  FrameProfile* frame = &profile->current;
+  for (int i = 0; i < profile->numWorkerCounters; i++) {
+    WorkerCounter* counter = &profile->workerCounters[i];
+    frame->bboxTests += counter->bboxTests;
+    counter->bboxTests = 0;
+    frame->cachedPairs += counter->cachedPairs;
+    counter->cachedPairs = 0;
+  }
+  frame->candidatePairs = candidatePairs;
+  frame->collisions = collisions;
+  frame->treeDepth = treeDepth;
+
+  if (profile->numFrames == profile->capacity) {
+    profile->capacity = profile->capacity == 0 ? 1024 : 2 * profile->capacity;
+    profile->frames = realloc(profile->frames,
+                              profile->capacity * sizeof(FrameProfile));
+    assert(profile->frames != NULL);
+  }
+  profile->frames[profile->numFrames++] = *frame;
+}
+
+void Profile_writeCSV(Profile* profile, FILE* out) {
+  // Convert counter ticks to microseconds with the rate observed since the
+  // profile was created.
+  double seconds = Profile_nanoseconds() * 1e-9 - profile->startSeconds;
+  uint64_t cycles = Profile_cycles() - profile->startCycles;
+  double usPerCycle = cycles > 0 ? seconds * 1e6 / cycles : 0;
+
+  fprintf(out, "frame");
+  for (int p = 0; p < NUM_PHASES; p++) {
+    fprintf(out, ",%s", phaseNames[p]);
+  }
+  fprintf(out, ",bbox_tests,candidate_pairs,bbox_rejection,collisions,"
+          "tree_depth,cached_pairs\n");
+
+  for (int i = 0; i < profile->numFrames; i++) {
+    FrameProfile* frame = &profile->frames[i];
+    fprintf(out, "%d", i + 1);
+    for (int p = 0; p < NUM_PHASES; p++) {
+      fprintf(out, ",%.3f", frame->cycles[p] * usPerCycle);
+    }
+    double rejection = frame->bboxTests > 0
+        ? 1.0 - (double) frame->candidatePairs / frame->bboxTests : 0;
+    fprintf(out, ",%llu,%llu,%.4f,%u,%d,%llu\n",
+            (unsigned long long) frame->bboxTests,
+            (unsigned long long) frame->candidatePairs, rejection,
+            frame->collisions, frame->treeDepth,
+            (unsigned long long) frame->cachedPairs);
+  }
+}
@@ -0,0 +1,116 @@
+/**
+ * profile.h -- per-phase frame profiler for CollisionWorld
+ *
+ * When a Profile is attached to a CollisionWorld, every frame records the
+ * time spent in each phase of CollisionWorld_updateLines, measured with the
+ * time-stamp counter, together with the number of bounding-box tests,
+ * candidate pairs, collisions and the depth of the quadtree.  The records
+ * are written as CSV at the end of the run.
+ **/
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+typedef enum {
+  PHASE_QUADTREE,  // renumbering, then QuadTree_update or BVH_update
+  PHASE_PAIRS,     // bounding-box tests and intersect() on candidate pairs
+  PHASE_SORT,      // sorting the intersection events
+  PHASE_RESOLVE,   // collision solver
+  PHASE_ADVANCE,   // moving the lines, walls and bounding boxes
+  NUM_PHASES
+} ProfilePhase;
+
+struct FrameProfile {
+  uint64_t cycles[NUM_PHASES];
+  uint64_t bboxTests;
+  uint64_t candidatePairs;
+  // Candidate pairs the pair cache let skip intersect().
+  uint64_t cachedPairs;
+  unsigned int collisions;
+  int treeDepth;
+};
+typedef struct FrameProfile FrameProfile;
+
+// Bounding-box tests and cached pairs counted by one worker during the
+// current frame, one cache line per worker so that workers do not share
+// lines.
+struct WorkerCounter {
+  uint64_t bboxTests;
+  uint64_t cachedPairs;
+  char padding[64 - 2 * sizeof(uint64_t)];
+};
+typedef struct WorkerCounter WorkerCounter;
+
+struct Profile {
+  FrameProfile* frames;
+  int numFrames;
+  int capacity;
+
+  // The frame being recorded and the counter value at its last mark.
+  FrameProfile current;
+  uint64_t mark;
+
+  // Calibration of the counter against the wall clock.
+  uint64_t startCycles;
+  double startSeconds;
+
+  // One counter per worker number, and a last one shared, with atomic
+  // updates, by any thread whose worker number is out of range.
+  WorkerCounter* workerCounters;
+  int numWorkerCounters;
+};
+typedef struct Profile Profile;
+
+// Monotonic clock in nanoseconds.
+uint64_t Profile_nanoseconds();
+
+// Read the time-stamp counter, or the monotonic clock where there is none.
+static inline uint64_t Profile_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return Profile_nanoseconds();
+#endif
+}
+
+Profile* Profile_new();
+
+void Profile_delete(Profile* profile);
+
+// Start recording a frame.
+void Profile_startFrame(Profile* profile);
+
+// Charge the time since the previous mark to phase.  Does nothing if
+// profile is NULL.
+static inline void Profile_mark(Profile* profile, ProfilePhase phase) {
+  if (profile == NULL) {
+    return;
+  }
+  uint64_t now = Profile_cycles();
+  profile->current.cycles[phase] += now - profile->mark;
+  profile->mark = now;
+}
+
+// Count n bounding-box tests on the calling worker.  Does nothing if
+// profile is NULL.
+void Profile_countBBoxTests(Profile* profile, uint64_t n);
+
+// Count n candidate pairs skipped by the pair cache on the calling worker.
+// Does nothing if profile is NULL.
+void Profile_countCachedPairs(Profile* profile, uint64_t n);
+
+// Finish the frame started by Profile_startFrame.
+void Profile_endFrame(Profile* profile, uint64_t candidatePairs,
+                      unsigned int collisions, int treeDepth);
+
+// Write one CSV row per frame, with phase times in microseconds.
+void Profile_writeCSV(Profile* profile, FILE* out);
+
+#endif  // PROFILE_H_
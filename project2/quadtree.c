@@ -3,11 +3,46 @@
 #include "./quadtree.h"
 #include "./vec.h"
 #include "./line.h"
+#include "./profile.h"
 
-extern IntersectionEventListReducer X;
+// Number of frames between two merge passes.
+#define MERGE_INTERVAL 8
 
-#define MAX_LINES 75
-#define MAX_DEPTH 8
+#define NODE_INITIAL_CAPACITY 64
+
+// Lines queried serially by QuadTree_loose_collisions.
+#define LOOSE_QUERY_GRAIN 64
+
+// Takes the next node from the arena, growing it if it is full.
+static int QuadTree_alloc_node(QuadTree* qt) {
+  if (qt->numNodes == qt->nodeCapacity) {
+    qt->nodeCapacity *= 2;
+    qt->nodes = realloc(qt->nodes, qt->nodeCapacity * sizeof(QuadTreeNode));
+  }
+  return qt->numNodes++;
+}
+
+static Bounds QuadTree_loosen(QuadTree* qt, Bounds bounds) {
+  double cx = (bounds.sw.x + bounds.ne.x) / 2.0;
+  double cy = (bounds.sw.y + bounds.ne.y) / 2.0;
+  double hx = (bounds.ne.x - bounds.sw.x) / 2.0 * qt->looseness;
+  double hy = (bounds.ne.y - bounds.sw.y) / 2.0 * qt->looseness;
+  Bounds loose;
+  loose.sw = Vec_make(cx - hx, cy - hy);
+  loose.ne = Vec_make(cx + hx, cy + hy);
+  return loose;
+}
+
+static void QuadTree_init_node(QuadTree* qt, QuadTreeNode* node,
+                               Bounds bounds, int parent, int depth) {
+  node->bounds = bounds;
+  node->loose = qt->looseness == 1 ? bounds : QuadTree_loosen(qt, bounds);
+  node->children = -1;
+  node->parent = parent;
+  node->current_depth = depth;
+  node->offset = 0;
+  node->count = 0;
+}
 
 QuadTree* QuadTree_make() {
   QuadTree* qt = malloc(sizeof(QuadTree));
@@ -15,40 +50,79 @@ QuadTree* QuadTree_make() {
 
   bounds.sw = Vec_make(BOX_XMIN, BOX_YMIN);
   bounds.ne = Vec_make(BOX_XMAX, BOX_YMAX);
-  qt->bounds = bounds;
-  qt->isLeaf = true;
-  qt->current_depth = 0;
-  qt->nodes = Vector_make();
-  qt->parent = NULL;
+
+  qt->nodeCapacity = NODE_INITIAL_CAPACITY;
+  qt->nodes = malloc(qt->nodeCapacity * sizeof(QuadTreeNode));
+  qt->numNodes = 0;
+  qt->looseness = 1;
+  qt->params = QuadTree_default_params();
+  QuadTree_init_node(qt, &qt->nodes[QuadTree_alloc_node(qt)], bounds, -1, 0);
+
+  qt->freeCapacity = NODE_INITIAL_CAPACITY / 4;
+  qt->freeGroups = malloc(qt->freeCapacity * sizeof(int));
+  qt->numFreeGroups = 0;
+  qt->updates = 0;
+
+  qt->lines = NULL;
+  qt->line_node = NULL;
+  qt->numLines = 0;
+  qt->lineCapacity = 0;
 
   return qt;
 }
 
-// assumes l1 within bounds of the tree
-void QuadTree_insert(QuadTree* qt, Line* line) {
-  assert(line != NULL);
+void QuadTree_delete(QuadTree* qt) {
+  if (qt == NULL) {
+    return;
+  }
+  free(qt->nodes);
+  free(qt->freeGroups);
+  free(qt->lines);
+  free(qt->line_node);
+  free(qt);
+}
 
-  if (qt->isLeaf) {
-    if (qt->current_depth >= MAX_DEPTH || qt->nodes->count < MAX_LINES) {
-      Vector_append(qt->nodes, line);
-    } else {
-      QuadTree_split(qt);
-      QuadTree_insert(qt, line);
-    }
+QuadTreeParams QuadTree_default_params() {
+  QuadTreeParams params;
+  params.maxLines = QUADTREE_MAX_LINES;
+  params.maxDepth = QUADTREE_MAX_DEPTH;
+  params.parallelDepth = QUADTREE_PARALLEL_DEPTH;
+  return params;
+}
+
+void QuadTree_set_params(QuadTree* qt, QuadTreeParams params) {
+  assert(params.maxLines > 0);
+  assert(params.maxDepth >= 0 && params.maxDepth <= QUADTREE_DEPTH_LIMIT);
+  qt->params = params;
+  qt->numNodes = 1;
+  qt->nodes[0].children = -1;
+  qt->numFreeGroups = 0;
+  qt->updates = 0;
+  for (int i = 0; i < qt->numLines; i++) {
+    qt->line_node[i] = 0;
+  }
+}
 
+void QuadTree_permute(QuadTree* qt, const int* order, int numLines) {
+  assert(numLines >= qt->numLines);
+  if (qt->numLines == 0) {
     return;
   }
+  int* line_node = malloc(qt->lineCapacity * sizeof(int));
+  assert(line_node != NULL);
+  // Lines the tree has not seen yet start at the root.
+  cilk_for (int i = 0; i < qt->numLines; i++) {
+    line_node[i] = order[i] < qt->numLines ? qt->line_node[order[i]] : 0;
+  }
+  free(qt->line_node);
+  qt->line_node = line_node;
+}
 
-  if (QuadTree_contains(qt->children[0], line)) {
-    QuadTree_insert(qt->children[0], line);
-  } else if (QuadTree_contains(qt->children[1], line)) {
-    QuadTree_insert(qt->children[1], line);
-  } else if (QuadTree_contains(qt->children[2], line)) {
-    QuadTree_insert(qt->children[2], line);
-  } else if (QuadTree_contains(qt->children[3], line)) {
-    QuadTree_insert(qt->children[3], line);
-  } else {
-    Vector_append(qt->nodes, line);
+void QuadTree_setLooseness(QuadTree* qt, double looseness) {
+  assert(looseness >= 1);
+  qt->looseness = looseness;
+  for (int i = 0; i < qt->numNodes; i++) {
+    qt->nodes[i].loose = QuadTree_loosen(qt, qt->nodes[i].bounds);
   }
 }
 
@@ -62,230 +136,496 @@ bool rect_intersect(Vec* sw1, Vec* ne1, Vec* sw2, Vec* ne2) {
              sw1->y > ne2->y || sw2->y > ne1->y);
 }
 
-
-inline bool QuadTree_contains(QuadTree* qt, Line* l) {
-  return rect_contains(&qt->bounds.sw, &qt->bounds.ne, &l->sw, &l->ne);
+static inline bool QuadTreeNode_contains(QuadTreeNode* node, Line* l) {
+  return rect_contains(&node->loose.sw, &node->loose.ne, &l->sw, &l->ne);
 }
 
-void Line_update_box(Line* line) {
-  line->sw.x = MIN(line->p1.x, line->p2.x) + MIN(line->velocity.x, 0);
-  line->sw.y = MIN(line->p1.y, line->p2.y) + MIN(line->velocity.y, 0);
-  line->ne.x = MAX(line->p1.x, line->p2.x) + MAX(line->velocity.x, 0);
-  line->ne.y = MAX(line->p1.y, line->p2.y) + MAX(line->velocity.y, 0);
+// Whether the center of the line's box is within the node's own bounds.
+static inline bool QuadTreeNode_holds_center(QuadTreeNode* node, Line* l) {
+  double x2 = l->sw.x + l->ne.x;
+  double y2 = l->sw.y + l->ne.y;
+  return 2 * node->bounds.sw.x <= x2 && x2 <= 2 * node->bounds.ne.x
+      && 2 * node->bounds.sw.y <= y2 && y2 <= 2 * node->bounds.ne.y;
 }
 
-void QuadTree_split(QuadTree* qt) {
-  assert(qt->nodes->count >= MAX_LINES);
+static inline bool QuadTreeNode_intersects(QuadTreeNode* node, Line* l) {
+  return rect_intersect(&node->loose.sw, &node->loose.ne, &l->sw, &l->ne);
+}
 
-  qt->isLeaf = false;
+void QuadTree_split(QuadTree* qt, int node) {
+  assert(qt->nodes[node].children < 0);
 
-  for (int i = 0; i < 4; i++) {
-    qt->children[i] = malloc(sizeof(QuadTree));
-    qt->children[i]->isLeaf = true;
-    qt->children[i]->current_depth = qt->current_depth + 1;
-    qt->children[i]->nodes = Vector_make();
-    qt->children[i]->parent = qt;
+  // Siblings are allocated together so they can be addressed as
+  // children + i.
+  int first;
+  if (qt->numFreeGroups > 0) {
+    first = qt->freeGroups[--qt->numFreeGroups];
+  } else {
+    first = QuadTree_alloc_node(qt);
+    for (int i = 1; i < 4; i++) {
+      QuadTree_alloc_node(qt);
+    }
   }
 
-  double mid_x = (qt->bounds.sw.x + qt->bounds.ne.x)/2.0;
-  double mid_y = (qt->bounds.sw.y + qt->bounds.ne.y)/2.0;
+  QuadTreeNode* n = &qt->nodes[node];
+  double mid_x = (n->bounds.sw.x + n->bounds.ne.x)/2.0;
+  double mid_y = (n->bounds.sw.y + n->bounds.ne.y)/2.0;
+  int depth = n->current_depth + 1;
 
   Bounds nw_bounds;
-  nw_bounds.sw = Vec_make(qt->bounds.sw.x, mid_y);
-  nw_bounds.ne = Vec_make(mid_x, qt->bounds.ne.y);
-  qt->children[0]->bounds = nw_bounds;
+  nw_bounds.sw = Vec_make(n->bounds.sw.x, mid_y);
+  nw_bounds.ne = Vec_make(mid_x, n->bounds.ne.y);
+  QuadTree_init_node(qt, &qt->nodes[first], nw_bounds, node, depth);
 
   Bounds ne_bounds;
   ne_bounds.sw = Vec_make(mid_x, mid_y);
-  ne_bounds.ne = Vec_make(qt->bounds.ne.x, qt->bounds.ne.y);
-  qt->children[1]->bounds = ne_bounds;
+  ne_bounds.ne = Vec_make(n->bounds.ne.x, n->bounds.ne.y);
+  QuadTree_init_node(qt, &qt->nodes[first + 1], ne_bounds, node, depth);
 
   Bounds se_bounds;
-  se_bounds.sw = Vec_make(mid_x, qt->bounds.sw.y);
-  se_bounds.ne = Vec_make(qt->bounds.ne.x, mid_y);
-  qt->children[2]->bounds = se_bounds;
+  se_bounds.sw = Vec_make(mid_x, n->bounds.sw.y);
+  se_bounds.ne = Vec_make(n->bounds.ne.x, mid_y);
+  QuadTree_init_node(qt, &qt->nodes[first + 2], se_bounds, node, depth);
 
   Bounds sw_bounds;
-  sw_bounds.sw = qt->bounds.sw;
+  sw_bounds.sw = n->bounds.sw;
   sw_bounds.ne = Vec_make(mid_x, mid_y);
-  qt->children[3]->bounds = sw_bounds;
+  QuadTree_init_node(qt, &qt->nodes[first + 3], sw_bounds, node, depth);
 
-  // vector* old_nodes = qt->nodes;
-  // vector* new_nodes = Vector_make();
+  n->children = first;
+}
 
-  // int count = old_nodes->count;
-  // qt->nodes = new_nodes;
-  // vector *old_nodes = qt->nodes;
-  // qt->nodes = Vector_make();
-  int count = qt->nodes->count;
-  Vector_switch(qt->nodes);
-  for (int i = 0; i < count; i++) {
-    QuadTree_insert(qt, qt->nodes->empty[i]);
+bool QuadTree_merge(QuadTree* qt, int node) {
+  QuadTreeNode* n = &qt->nodes[node];
+  if (n->children < 0) {
+    return false;
+  }
+
+  int children = n->children;
+  bool merged = false;
+  for (int i = 0; i < 4; i++) {
+    merged |= QuadTree_merge(qt, children + i);
+  }
+
+  // Merge only the lowest internal nodes; the recursion above has already
+  // collapsed whatever could be collapsed below.
+  int count = n->count;
+  for (int i = 0; i < 4; i++) {
+    QuadTreeNode* child = &qt->nodes[children + i];
+    if (child->children >= 0) {
+      return merged;
+    }
+    count += child->count;
+  }
+  // Half of maxLines, well below it, so that a node does not flip between
+  // split and merged every frame.
+  if (count > qt->params.maxLines / 2) {
+    return merged;
+  }
+
+  // Counts stay valid so that merging can cascade up the tree.  The
+  // children keep their parent index until they are reused, which is how
+  // their lines find this node again.
+  n->count = count;
+  n->children = -1;
+  if (qt->numFreeGroups == qt->freeCapacity) {
+    qt->freeCapacity *= 2;
+    qt->freeGroups = realloc(qt->freeGroups, qt->freeCapacity * sizeof(int));
   }
-  // Vector_free(old_nodes);
+  qt->freeGroups[qt->numFreeGroups++] = children;
+  return true;
 }
 
-void Vector_intersect_node(Line* l1, vector* v,
-                                 IntersectionEventList* intersectionEventList,
-                                 CollisionWorld* collisionWorld) {
-  int cmp;
-  for (int i = 0; i < v->count; i++) {
-    Line* l2 = v->data[i];
-    // intersect expects compareLines(l1, l2) < 0 to be true.
-    // Swap l1 and l2, if necessary.
-    // IntersectionType ml =
-    //       intersect(l1, l2);
-    if (!rect_intersect(&l1->sw, &l1->ne,
-                           &l2->sw, &l2->ne)) {
-        assert(ml == NO_INTERSECTION);
+// Returns the node a line ends up in after merging: the topmost leaf on the
+// path from its old node to the root, or the old node if there is none.
+static int QuadTree_merged_node(QuadTree* qt, int node) {
+  int result = node;
+  for (int n = qt->nodes[node].parent; n >= 0; n = qt->nodes[n].parent) {
+    if (qt->nodes[n].children < 0) {
+      result = n;
+    }
+  }
+  return result;
+}
+
+// Returns the child of node (nw, ne, se, sw) whose quadrant holds the
+// center of the line's box.  A child that contains the box is always that
+// one, and in a loose quadtree it is the child the box is most likely to
+// fit in.
+static inline int QuadTree_center_child(QuadTreeNode* node, Line* line) {
+  double mid_x = (node->bounds.sw.x + node->bounds.ne.x)/2.0;
+  double mid_y = (node->bounds.sw.y + node->bounds.ne.y)/2.0;
+  bool east = line->sw.x + line->ne.x >= 2 * mid_x;
+  bool north = line->sw.y + line->ne.y >= 2 * mid_y;
+  if (north) {
+    return node->children + (east ? 1 : 0);
+  }
+  return node->children + (east ? 2 : 3);
+}
+
+// Starting from the node the line was in, finds the deepest node that
+// contains the line's box.
+static int QuadTree_place(QuadTree* qt, int node, Line* line) {
+  QuadTreeNode* nodes = qt->nodes;
+
+  // In a loose quadtree, a line whose center has moved out of its node
+  // may fit deeper under a neighbor, so it is placed again from higher up.
+  while (nodes[node].parent >= 0
+         && !(QuadTreeNode_contains(&nodes[node], line)
+              && QuadTreeNode_holds_center(&nodes[node], line))) {
+    node = nodes[node].parent;
+  }
+
+  while (nodes[node].children >= 0) {
+    int child = QuadTree_center_child(&nodes[node], line);
+    if (!QuadTreeNode_contains(&nodes[child], line)) {
+      break;
     }
+    node = child;
+  }
+  return node;
+}
+
+// Counting sort of the lines by node into the line buffer.
+static void QuadTree_fill(QuadTree* qt, Line** lines, int numLines) {
+  QuadTreeNode* nodes = qt->nodes;
+
+  for (int i = 0; i < qt->numNodes; i++) {
+    nodes[i].count = 0;
+  }
+  for (int i = 0; i < numLines; i++) {
+    nodes[qt->line_node[i]].count++;
+  }
+
+  int offset = 0;
+  for (int i = 0; i < qt->numNodes; i++) {
+    nodes[i].offset = offset;
+    offset += nodes[i].count;
+    nodes[i].count = 0;
+  }
+
+  for (int i = 0; i < numLines; i++) {
+    QuadTreeNode* node = &nodes[qt->line_node[i]];
+    qt->lines[node->offset + node->count++] = lines[i];
+  }
+}
+
+void QuadTree_update(QuadTree* qt, Line** lines, int numLines) {
+  if (numLines > qt->lineCapacity) {
+    qt->lines = realloc(qt->lines, numLines * sizeof(Line*));
+    qt->line_node = realloc(qt->line_node, numLines * sizeof(int));
+    qt->lineCapacity = numLines;
+  }
+  for (int i = qt->numLines; i < numLines; i++) {
+    qt->line_node[i] = 0;
+  }
+  qt->numLines = numLines;
+  qt->updates++;
+
+  cilk_for (int i = 0; i < numLines; i++) {
+    qt->line_node[i] = QuadTree_place(qt, qt->line_node[i], lines[i]);
+  }
+  QuadTree_fill(qt, lines, numLines);
+
+  // Lines leave regions over time; collapse the subtrees they left behind.
+  if (qt->updates % MERGE_INTERVAL == 0 && QuadTree_merge(qt, 0)) {
+    cilk_for (int i = 0; i < numLines; i++) {
+      qt->line_node[i] = QuadTree_merged_node(qt, qt->line_node[i]);
+    }
+    QuadTree_fill(qt, lines, numLines);
+  }
+
+  // Split overfull leaves and place their lines again.
+  bool split = true;
+  while (split) {
+    split = false;
+    int numNodes = qt->numNodes;
+    for (int i = 0; i < numNodes; i++) {
+      QuadTreeNode* node = &qt->nodes[i];
+      if (node->children < 0 && node->count > qt->params.maxLines
+          && node->current_depth < qt->params.maxDepth) {
+        QuadTree_split(qt, i);
+        split = true;
+      }
+    }
+
+    if (split) {
+      cilk_for (int i = 0; i < numLines; i++) {
+        qt->line_node[i] = QuadTree_place(qt, qt->line_node[i], lines[i]);
+      }
+      QuadTree_fill(qt, lines, numLines);
+    }
+  }
+}
+
+// Test a pair of lines whose bounding boxes overlap and record an event if
+// they collide during this frame.  In event-driven mode every candidate pair
+// is recorded, and the contact time is computed later.  Returns 1 if the
+// pair cache showed that the pair cannot collide, 0 otherwise.
+static inline int QuadTree_test_pair(Line* l1, Line* l2,
+                                     CollisionWorld* collisionWorld) {
+  // intersect expects compareLines(l1, l2) < 0 to be true.
+  // Swap l1 and l2, if necessary.
+  if (compareLines(l1, l2) > 0) {
+    Line* temp = l1;
+    l1 = l2;
+    l2 = temp;
+  }
+  if (collisionWorld->eventDriven) {
+    EventBuffer_append(&collisionWorld->buffer, l1, l2, NO_INTERSECTION);
+    return 0;
+  }
+  PairCache* cache = &collisionWorld->pairCache;
+  PairCacheEntry* entry = PairCache_find(cache, l1, l2);
+  if (entry != NULL
+      && PairCache_separated(cache, entry, l1, l2, collisionWorld->timeStep)) {
+    return 1;
+  }
+  IntersectionType intersectionType =
+    intersect(l1, l2, collisionWorld->timeStep);
+  if (entry != NULL) {
+    PairCache_record(cache, entry, l1, l2, intersectionType);
+  }
+  if (intersectionType != NO_INTERSECTION) {
+    EventBuffer_append(&collisionWorld->buffer, l1, l2, intersectionType);
+  }
+  return 0;
+}
+
+uint64_t Lines_intersect_line(Line* l1, Line** lines, int count,
+                              CollisionWorld* collisionWorld) {
+  uint64_t candidates = 0;
+  uint64_t cached = 0;
+  Profile_countBBoxTests(collisionWorld->profile, count);
+  for (int i = 0; i < count; i++) {
+    Line* l2 = lines[i];
     if (rect_intersect(&l1->sw, &l1->ne,
                        &l2->sw, &l2->ne)) {
-        cmp = compareLines(l1, l2);
-        if (cmp > 0) {
-        IntersectionType intersectionType =
-          intersect(l2, l1, collisionWorld->timeStep);
-        if (intersectionType != NO_INTERSECTION) {
-          IntersectionEventList_appendNode(&REDUCER_VIEW(X), l2, l1,
-                                           intersectionType);
-        }
-      } else { 
-        IntersectionType intersectionType =
-          intersect(l1, l2, collisionWorld->timeStep);
-        if (intersectionType != NO_INTERSECTION) {
-          IntersectionEventList_appendNode(&REDUCER_VIEW(X), l1, l2,
-                                           intersectionType);
-        }
-      }
+      candidates++;
+      cached += QuadTree_test_pair(l1, l2, collisionWorld);
     }
   }
+  Profile_countCachedPairs(collisionWorld->profile, cached);
+  return candidates;
 }
 
-void QuadTree_intersect_node(QuadTree* qt,
-                         IntersectionEventList* intersectionEventList,
-                         Line* line,
-                         CollisionWorld* collisionWorld) {
+uint64_t QuadTree_intersect_node(QuadTree* qt, int node, Line* line,
+                                 CollisionWorld* collisionWorld) {
   assert(line != NULL);
+  QuadTreeNode* n = &qt->nodes[node];
 
-  Vector_intersect_node(line, qt->nodes,
-                        &REDUCER_VIEW(X),
-                        collisionWorld);
+  uint64_t candidates =
+      Lines_intersect_line(line, qt->lines + n->offset, n->count,
+                           collisionWorld);
 
-  if (!qt->isLeaf) {
+  if (n->children >= 0) {
     for (int i = 0; i < 4; i++) {
-      if (rect_intersect(&qt->children[i]->bounds.sw, &qt->children[i]->bounds.ne,
-                         &line->sw, &line->ne)) {
-         QuadTree_intersect_node(qt->children[i], &REDUCER_VIEW(X), line, collisionWorld);
+      if (QuadTreeNode_intersects(&qt->nodes[n->children + i], line)) {
+         candidates += QuadTree_intersect_node(qt, n->children + i, line,
+                                               collisionWorld);
       }
     }
   }
+  return candidates;
 }
 
-void QuadTree_collisions(QuadTree* qt,
-                         IntersectionEventList* intersectionEventList,
-                         CollisionWorld* collisionWorld) {
+uint64_t QuadTree_collisions(QuadTree* qt, int node,
+                             CollisionWorld* collisionWorld) {
   assert(qt != NULL);
+  QuadTreeNode* n = &qt->nodes[node];
+  Line** lines = qt->lines + n->offset;
+  uint64_t candidates = 0;
+  uint64_t childCandidates[4] = {0, 0, 0, 0};
 
-  cilk_spawn Vector_intersect(qt->nodes, qt->nodes,
-                   &REDUCER_VIEW(X),
-                   collisionWorld);
+  uint64_t ownCandidates = cilk_spawn Lines_intersect(lines, n->count,
+                                                      collisionWorld);
 
-  if (!qt->isLeaf) {
+  if (n->children >= 0) {
+    int children = n->children;
     Line *line;
-    for (int i = 0; i < qt->nodes->count; i++) {
-        line = qt->nodes->data[i];
+    for (int i = 0; i < n->count; i++) {
+        line = lines[i];
         for (int i = 0; i < 4; i++) {
-          if (rect_intersect(&qt->children[i]->bounds.sw, &qt->children[i]->bounds.ne,
-                             &line->sw, &line->ne)) {
-            QuadTree_intersect_node(qt->children[i], &REDUCER_VIEW(X), line, collisionWorld);
+          if (QuadTreeNode_intersects(&qt->nodes[children + i], line)) {
+            candidates += QuadTree_intersect_node(qt, children + i, line,
+                                                  collisionWorld);
           }
         }
       }
 
-    if (qt->current_depth < MAX_DEPTH - 2) {
+    if (n->current_depth < qt->params.parallelDepth) {
       cilk_for (int i = 0; i < 4; i++) {
-        QuadTree_collisions(qt->children[i], &REDUCER_VIEW(X), collisionWorld);
+        childCandidates[i] = QuadTree_collisions(qt, children + i,
+                                                 collisionWorld);
       }
     } else {
       for (int i = 0; i < 4; i++) {
-        QuadTree_collisions(qt->children[i], &REDUCER_VIEW(X), collisionWorld);
+        childCandidates[i] = QuadTree_collisions(qt, children + i,
+                                                 collisionWorld);
       }
     }
   }
   cilk_sync;
+  return candidates + ownCandidates + childCandidates[0] + childCandidates[1]
+      + childCandidates[2] + childCandidates[3];
 }
 
-void Vector_intersect(vector* v1, vector* v2,
-                            IntersectionEventList* intersectionEventList,
-                            CollisionWorld* collisionWorld) {
-  int cmp;
-  for (int i = 0; i < v1->count; i++) {
-    Line* l1 = v1->data[i];
-    for (int j = i+1; j < v2->count; j++) {
-      Line* l2 = v2->data[j];
-      // intersect expects compareLines(l1, l2) < 0 to be true.
-      // Swap l1 and l2, if necessary.
-    if (!rect_intersect(&l1->sw, &l1->ne,&l2->sw, &l2->ne)) {
-        assert(ml == NO_INTERSECTION);
+// Tests line i of the line buffer against the lines after it in node and
+// in every node under it whose loose bounds the line's box overlaps.
+static uint64_t QuadTree_loose_query(QuadTree* qt, int node, int i,
+                                     CollisionWorld* collisionWorld) {
+  QuadTreeNode* n = &qt->nodes[node];
+  Line* line = qt->lines[i];
+  uint64_t candidates = 0;
+
+  int start = MAX(n->offset, i + 1);
+  int end = n->offset + n->count;
+  if (start < end) {
+    candidates += Lines_intersect_line(line, qt->lines + start, end - start,
+                                       collisionWorld);
+  }
+  if (n->children >= 0) {
+    for (int c = 0; c < 4; c++) {
+      if (QuadTreeNode_intersects(&qt->nodes[n->children + c], line)) {
+        candidates += QuadTree_loose_query(qt, n->children + c, i,
+                                           collisionWorld);
+      }
+    }
+  }
+  return candidates;
+}
+
+static uint64_t QuadTree_loose_range(QuadTree* qt, int lo, int hi,
+                                     CollisionWorld* collisionWorld) {
+  if (hi - lo <= LOOSE_QUERY_GRAIN) {
+    uint64_t candidates = 0;
+    for (int i = lo; i < hi; i++) {
+      candidates += QuadTree_loose_query(qt, 0, i, collisionWorld);
     }
+    return candidates;
+  }
+  int mid = lo + (hi - lo) / 2;
+  uint64_t left = cilk_spawn QuadTree_loose_range(qt, lo, mid,
+                                                  collisionWorld);
+  uint64_t right = QuadTree_loose_range(qt, mid, hi, collisionWorld);
+  cilk_sync;
+  return left + right;
+}
+
+uint64_t QuadTree_loose_collisions(QuadTree* qt,
+                                   CollisionWorld* collisionWorld) {
+  return QuadTree_loose_range(qt, 0, qt->numLines, collisionWorld);
+}
+
+uint64_t Lines_intersect(Line** lines, int count,
+                         CollisionWorld* collisionWorld) {
+  uint64_t candidates = 0;
+  uint64_t cached = 0;
+  Profile_countBBoxTests(collisionWorld->profile,
+                         (uint64_t) count * (count - 1) / 2);
+  for (int i = 0; i < count; i++) {
+    Line* l1 = lines[i];
+    for (int j = i+1; j < count; j++) {
+      Line* l2 = lines[j];
       if (rect_intersect(&l1->sw, &l1->ne,
                          &l2->sw, &l2->ne)) {
-        if (l1->id > l2->id) {
-            IntersectionType intersectionType =
-              intersect(l2, l1, collisionWorld->timeStep);
-          if (intersectionType != NO_INTERSECTION) {
-            IntersectionEventList_appendNode(&REDUCER_VIEW(X), l2, l1,
-                                             intersectionType);
-          }
-        } else { 
-          IntersectionType intersectionType =
-            intersect(l1, l2, collisionWorld->timeStep);
-          if (intersectionType != NO_INTERSECTION) {
-            IntersectionEventList_appendNode(&REDUCER_VIEW(X), l1, l2,
-                                             intersectionType);
-          }
-        }
+        candidates++;
+        cached += QuadTree_test_pair(l1, l2, collisionWorld);
       }
     }
   }
+  Profile_countCachedPairs(collisionWorld->profile, cached);
+  return candidates;
 }
 
-void QuadTree_delete(QuadTree* qt) {
-  if (qt == NULL) {
-    return;
-  }
-  if (!qt->isLeaf) {
+struct QuadTreeStats {
+  int nodes[QUADTREE_DEPTH_LIMIT + 1];
+  int leaves[QUADTREE_DEPTH_LIMIT + 1];
+  int lines[QUADTREE_DEPTH_LIMIT + 1];
+  // Leaves with at most maxLines lines by number of lines: 0, 1-8, 9-16,
+  // 17-32, 33-64, 65 or more; then leaves with more than maxLines (only
+  // possible at maxDepth).
+  int leafLines[7];
+  int maxLeafLines;
+  // Lines held by internal nodes, which are tested against whole subtrees.
+  int internalLines;
+};
+typedef struct QuadTreeStats QuadTreeStats;
+
+static void QuadTree_collect_stats(QuadTree* qt, int node,
+                                   QuadTreeStats* stats) {
+  QuadTreeNode* n = &qt->nodes[node];
+  int depth = n->current_depth;
+
+  stats->nodes[depth]++;
+  stats->lines[depth] += n->count;
+
+  if (n->children >= 0) {
+    stats->internalLines += n->count;
     for (int i = 0; i < 4; i++) {
-      QuadTree* cur_qt = qt->children[i];
-      if (cur_qt != NULL) {
-        QuadTree_delete(qt->children[i]);
-        qt->children[i] = NULL;
-      }
+      QuadTree_collect_stats(qt, n->children + i, stats);
     }
+    return;
   }
-  Vector_free(qt->nodes);
-  qt->nodes = NULL;
-  free(qt);
-  qt = NULL;
-}
 
-void QuadTree_increase_node(QuadTree* qt, Line* line) {
-  while (qt->parent != NULL && !QuadTree_contains(qt, line)) {
-    qt = qt->parent;
+  stats->leaves[depth]++;
+  stats->maxLeafLines = MAX(stats->maxLeafLines, n->count);
+  int bucket;
+  if (n->count > qt->params.maxLines) {
+    bucket = 6;
+  } else if (n->count == 0) {
+    bucket = 0;
+  } else if (n->count <= 8) {
+    bucket = 1;
+  } else if (n->count <= 16) {
+    bucket = 2;
+  } else if (n->count <= 32) {
+    bucket = 3;
+  } else if (n->count <= 64) {
+    bucket = 4;
+  } else {
+    bucket = 5;
   }
-  QuadTree_insert(qt, line);
+  stats->leafLines[bucket]++;
 }
 
-void QuadTree_update(QuadTree* qt) {
-  int count = qt->nodes->count;
-  Vector_switch(qt->nodes);
-  for (int i = 0; i < count; i++) {
-    QuadTree_increase_node(qt, qt->nodes->empty[i]);
+int QuadTree_depth(QuadTree* qt, int node) {
+  QuadTreeNode* n = &qt->nodes[node];
+  if (n->children < 0) {
+    return n->current_depth;
   }
+  int depth = 0;
+  for (int i = 0; i < 4; i++) {
+    depth = MAX(depth, QuadTree_depth(qt, n->children + i));
+  }
+  return depth;
+}
 
-  if (!qt->isLeaf) {
-    for (int i = 0; i < 4; i++) {
-      QuadTree_update(qt->children[i]);
+void QuadTree_print_stats(QuadTree* qt, FILE* out) {
+  QuadTreeStats stats = {{0}};
+  QuadTree_collect_stats(qt, 0, &stats);
+
+  int nodes = 0;
+  int leaves = 0;
+  fprintf(out, "---- QUADTREE (update %d, looseness %g) ----\n", qt->updates,
+          qt->looseness);
+  fprintf(out, "depth  nodes  leaves  lines\n");
+  for (int d = 0; d <= qt->params.maxDepth; d++) {
+    if (stats.nodes[d] == 0) {
+      continue;
     }
+    fprintf(out, "%5d  %5d  %6d  %5d\n", d, stats.nodes[d], stats.leaves[d],
+            stats.lines[d]);
+    nodes += stats.nodes[d];
+    leaves += stats.leaves[d];
   }
+  fprintf(out, "%d nodes, %d leaves, %d free node groups, %d lines in "
+          "internal nodes\n", nodes, leaves, qt->numFreeGroups,
+          stats.internalLines);
+  fprintf(out, "lines per leaf: 0:%d 1-8:%d 9-16:%d 17-32:%d 33-64:%d "
+          "65+:%d >%d:%d (max %d)\n",
+          stats.leafLines[0], stats.leafLines[1], stats.leafLines[2],
+          stats.leafLines[3], stats.leafLines[4], stats.leafLines[5],
+          qt->params.maxLines, stats.leafLines[6],
+          stats.maxLeafLines);
 }
@@ -1,37 +1,87 @@
+#ifndef QUADTREE_H_
+#define QUADTREE_H_
+
 #include <assert.h>
+#include <stdio.h>
 
 #include "./intersection_detection.h"
 #include "./intersection_event_list.h"
 #include "./line.h"
 #include "./vec.h"
 #include "./collision_world.h"
-#include "./vector.h"
 #include "./types.h"
 
-void QuadTree_insert(QuadTree* qt, Line* qn);
+// Default QuadTreeParams.
+#define QUADTREE_MAX_LINES 75
+#define QUADTREE_MAX_DEPTH 8
+#define QUADTREE_PARALLEL_DEPTH (QUADTREE_MAX_DEPTH - 2)
 
-bool QuadTree_contains(QuadTree* qt, Line* line);
+// No quadtree gets deeper than this, whatever its parameters.
+#define QUADTREE_DEPTH_LIMIT 16
 
-void QuadTree_collisions(QuadTree* qt,
-                         IntersectionEventList* intersectionEventList,
-                         CollisionWorld* collisionWorld);
+// Looseness of the quadtree in BROAD_PHASE_LOOSE_QUADTREE mode.
+#define LOOSE_QUADTREE_FACTOR 1.25
 
 QuadTree* QuadTree_make();
 
-int QuadTree_count_lines(QuadTree* qt);
-
 void QuadTree_delete(QuadTree* qt);
 
-void QuadTree_split(QuadTree* qt);
+QuadTreeParams QuadTree_default_params();
+
+// Sets the parameters of the tree and takes it back to a single root, so
+// that the next QuadTree_update builds it again with them.
+void QuadTree_set_params(QuadTree* qt, QuadTreeParams params);
+
+// The lines given to QuadTree_update were reordered: from now on, line i
+// is the one that was line order[i].
+void QuadTree_permute(QuadTree* qt, const int* order, int numLines);
+
+// Enlarges the bounds of every node by a factor looseness >= 1 about its
+// center, making this a loose quadtree.  A line then stays in a node
+// unless it sticks out of the node's enlarged bounds, so fewer lines that
+// straddle a midline are held above the leaves.
+void QuadTree_setLooseness(QuadTree* qt, double looseness);
+
+// Places every line in the deepest node that contains its box, splitting
+// overfull leaves, and rebuilds the line buffer.
+void QuadTree_update(QuadTree* qt, Line** lines, int numLines);
+
+// Splits a leaf into four children.  Does not move any lines.
+void QuadTree_split(QuadTree* qt, int node);
 
-void QuadTree_update(QuadTree* qt);
+// Collapses every subtree whose children are leaves holding few enough
+// lines into its root.  Returns true if anything was merged.  The line
+// buffer has to be rebuilt afterwards.
+bool QuadTree_merge(QuadTree* qt, int node);
 
-void Vector_intersect(vector* v1, vector* v2, 
-                            IntersectionEventList* intersectionEventList,
-                            CollisionWorld* collisionWorld);
+// Whether the box (sw1, ne1) strictly contains the box (sw2, ne2).
+bool rect_contains(Vec* sw1, Vec* ne1, Vec* sw2, Vec* ne2);
+
+// Whether the boxes (sw1, ne1) and (sw2, ne2) overlap.
+bool rect_intersect(Vec* sw1, Vec* ne1, Vec* sw2, Vec* ne2);
+
+// Returns the depth of the deepest leaf under node.
+int QuadTree_depth(QuadTree* qt, int node);
+
+// Prints the number of nodes, leaves and lines at each depth and the
+// distribution of lines per leaf.
+void QuadTree_print_stats(QuadTree* qt, FILE* out);
+
+// The functions below return the number of candidate pairs (pairs whose
+// boxes overlap) they passed to intersect().
+uint64_t QuadTree_collisions(QuadTree* qt, int node,
+                             CollisionWorld* collisionWorld);
+
+// Pair search for a loose quadtree, where the subtrees of sibling nodes can
+// overlap: every line is tested against the lines after it in the line
+// buffer that are in nodes its box overlaps.
+uint64_t QuadTree_loose_collisions(QuadTree* qt,
+                                   CollisionWorld* collisionWorld);
+
+uint64_t Lines_intersect(Line** lines, int count,
+                         CollisionWorld* collisionWorld);
 
-void Vector_intersect_node(Line* line, vector* v,
-                            IntersectionEventList* intersectionEventList,
-                            CollisionWorld* collisionWorld);
+uint64_t Lines_intersect_line(Line* line, Line** lines, int count,
+                              CollisionWorld* collisionWorld);
 
-void Line_update_box(Line* line);
+#endif  // QUADTREE_H_
@@ -0,0 +1,180 @@
+/**
+ * scene.c -- read and write line scenes
+ **/
+
+#include "./scene.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cilk/cilk.h>
+
+// Number of double arrays following the header of a binary scene.
+#define SCENE_ARRAYS 6
+
+static size_t Scene_binarySize(unsigned int numOfLines) {
+  return sizeof(SceneHeader)
+      + (size_t) numOfLines * (SCENE_ARRAYS * sizeof(double) + 1);
+}
+
+bool Scene_isBinary(const char* path) {
+  SceneHeader header;
+  FILE* fin = fopen(path, "rb");
+  if (fin == NULL) {
+    return false;
+  }
+  bool binary = fread(&header, sizeof(header), 1, fin) == 1
+      && memcmp(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) == 0;
+  fclose(fin);
+  return binary;
+}
+
+Line* Scene_readText(const char* path, unsigned int* numOfLines) {
+  unsigned int lineId = 0;
+  window_dimension px1;
+  window_dimension py1;
+  window_dimension px2;
+  window_dimension py2;
+  window_dimension vx;
+  window_dimension vy;
+  int isGray;
+  FILE *fin;
+  fin = fopen(path, "r");
+  if (fin == NULL) {
+    return NULL;
+  }
+
+  if (fscanf(fin, "%u\n", numOfLines) != 1) {
+    fclose(fin);
+    return NULL;
+  }
+  Line* lines = malloc(*numOfLines * sizeof(Line));
+  if (lines == NULL) {
+    fclose(fin);
+    return NULL;
+  }
+
+  while (lineId < *numOfLines
+      && EOF != fscanf(fin, "(%lf, %lf), (%lf, %lf), %lf, %lf, %d\n", &px1,
+                       &py1, &px2, &py2, &vx, &vy, &isGray)) {
+    Line *line = &lines[lineId];
+
+    // convert window coordinates to box coordinates
+    windowToBox(&line->p1.x, &line->p1.y, px1, py1);
+    windowToBox(&line->p2.x, &line->p2.y, px2, py2);
+
+    // convert window velocity to box velocity
+    velocityWindowToBox(&line->velocity.x, &line->velocity.y, vx, vy);
+
+    // store color
+    line->color = (Color) isGray;
+
+    // store line ID
+    line->id = lineId;
+    lineId++;
+  }
+  fclose(fin);
+
+  *numOfLines = lineId;
+  return lines;
+}
+
+Line* Scene_readBinary(const char* path, unsigned int* numOfLines) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(SceneHeader)) {
+    close(fd);
+    return NULL;
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  const SceneHeader* header = map;
+  unsigned int n = header->numOfLines;
+  if (memcmp(header->magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0
+      || header->version != SCENE_VERSION
+      || st.st_size < Scene_binarySize(n)) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  const double* p1x = (const double*) (header + 1);
+  const double* p1y = p1x + n;
+  const double* p2x = p1y + n;
+  const double* p2y = p2x + n;
+  const double* vx = p2y + n;
+  const double* vy = vx + n;
+  const uint8_t* color = (const uint8_t*) (vy + n);
+
+  Line* lines = malloc((size_t) n * sizeof(Line));
+  if (lines != NULL) {
+    cilk_for (unsigned int i = 0; i < n; i++) {
+      lines[i].p1.x = p1x[i];
+      lines[i].p1.y = p1y[i];
+      lines[i].p2.x = p2x[i];
+      lines[i].p2.y = p2y[i];
+      lines[i].velocity.x = vx[i];
+      lines[i].velocity.y = vy[i];
+      lines[i].color = (Color) color[i];
+      lines[i].id = i;
+    }
+  }
+  munmap(map, st.st_size);
+
+  *numOfLines = n;
+  return lines;
+}
+
+int Scene_writeBinary(const char* path, const Line* lines,
+                      unsigned int numOfLines) {
+  FILE* fout = fopen(path, "wb");
+  if (fout == NULL) {
+    return -1;
+  }
+
+  SceneHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+  header.version = SCENE_VERSION;
+  header.numOfLines = numOfLines;
+  bool ok = fwrite(&header, sizeof(header), 1, fout) == 1;
+
+  // Write the arrays one field at a time.
+  double* column = malloc((size_t) numOfLines * sizeof(double));
+  for (int field = 0; ok && field < SCENE_ARRAYS; field++) {
+    for (unsigned int i = 0; i < numOfLines; i++) {
+      const Line* line = &lines[i];
+      switch (field) {
+        case 0: column[i] = line->p1.x; break;
+        case 1: column[i] = line->p1.y; break;
+        case 2: column[i] = line->p2.x; break;
+        case 3: column[i] = line->p2.y; break;
+        case 4: column[i] = line->velocity.x; break;
+        default: column[i] = line->velocity.y; break;
+      }
+    }
+    ok = fwrite(column, sizeof(double), numOfLines, fout) == numOfLines;
+  }
+  free(column);
+
+  for (unsigned int i = 0; ok && i < numOfLines; i++) {
+    ok = fputc((uint8_t) lines[i].color, fout) != EOF;
+  }
+
+  if (fclose(fout) != 0) {
+    ok = false;
+  }
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,48 @@
+/**
+ * scene.h -- read and write line scenes
+ *
+ * Scenes come in two formats.  The text format (the .in files in input/)
+ * starts with the number of lines followed by one line per line segment:
+ *
+ *   (x1, y1), (x2, y2), vx, vy, color
+ *
+ * in window coordinates.  The binary format is a SceneHeader followed by
+ * numOfLines doubles for each of p1.x, p1.y, p2.x, p2.y, velocity.x and
+ * velocity.y (already in box coordinates), then numOfLines color bytes.
+ * It is loaded with mmap and needs no parsing or conversion.
+ **/
+
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./line.h"
+
+#define SCENE_MAGIC "LINESCN"
+#define SCENE_VERSION 1
+
+struct SceneHeader {
+  char magic[8];  // SCENE_MAGIC, NUL-terminated
+  uint32_t version;
+  uint32_t numOfLines;
+};
+typedef struct SceneHeader SceneHeader;
+
+// Returns true if the file starts with the binary scene magic.
+bool Scene_isBinary(const char* path);
+
+// Read a text scene.  Returns an array of *numOfLines lines with IDs
+// 0, 1, ..., to be released with free(), or NULL on error.
+Line* Scene_readText(const char* path, unsigned int* numOfLines);
+
+// Map a binary scene and copy it into a new line array.  Same contract as
+// Scene_readText.
+Line* Scene_readBinary(const char* path, unsigned int* numOfLines);
+
+// Write lines[0, numOfLines) as a binary scene.  Returns 0 on success.
+int Scene_writeBinary(const char* path, const Line* lines,
+                      unsigned int numOfLines);
+
+#endif  // SCENE_H_
@@ -0,0 +1,32 @@
+/**
+ * scene_convert.c -- convert a text scene (.in) to the binary scene format
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./scene.h"
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    printf("Usage: %s <input.in> <output.scn>\n", argv[0]);
+    exit(-1);
+  }
+
+  unsigned int numOfLines;
+  Line* lines = Scene_readText(argv[1], &numOfLines);
+  if (lines == NULL) {
+    fprintf(stderr, "Could not read scene (%s)\n", argv[1]);
+    exit(1);
+  }
+
+  if (Scene_writeBinary(argv[2], lines, numOfLines) != 0) {
+    fprintf(stderr, "Could not write scene (%s)\n", argv[2]);
+    free(lines);
+    exit(1);
+  }
+  printf("Wrote %u lines to %s\n", numOfLines, argv[2]);
+
+  free(lines);
+  return 0;
+}
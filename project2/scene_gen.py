@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Generate large screensaver scenes in the input/*.in text format.
+
+Each line of the output is
+
+    (x1, y1), (x2, y2), vx, vy, color
+
+in window coordinates (WINDOW_WIDTH x WINDOW_HEIGHT in line.h), preceded by
+the number of lines.  Examples:
+
+    ./scene_gen.py -n 100000 -o input/gen_100k.in
+    ./scene_gen.py -n 1000000 --density 0.25 --length-dist exp \\
+        --speed-dist normal --speed 2 -o input/gen_1m_dense.in
+"""
+
+import argparse
+import math
+import random
+import sys
+
+WINDOW_WIDTH = 1180
+WINDOW_HEIGHT = 800
+
+# Keep endpoints this far from the walls so no line starts outside the box.
+MARGIN = 1.0
+
+
+def sample(rng, dist, mean):
+    """Draw a non-negative value with the given mean from a distribution."""
+    if mean == 0:
+        return 0.0
+    if dist == "fixed":
+        return mean
+    if dist == "uniform":
+        return rng.uniform(0, 2 * mean)
+    if dist == "exp":
+        return rng.expovariate(1.0 / mean)
+    if dist == "normal":
+        return abs(rng.gauss(mean, mean / 3))
+    raise ValueError("unknown distribution: " + dist)
+
+
+def generate(args, out):
+    rng = random.Random(args.seed)
+
+    # The lines are spread over a centered region covering `density` of the
+    # window, so a smaller density packs the same lines closer together.
+    side = math.sqrt(args.density)
+    width = (WINDOW_WIDTH - 2 * MARGIN) * side
+    height = (WINDOW_HEIGHT - 2 * MARGIN) * side
+    x0 = (WINDOW_WIDTH - width) / 2
+    y0 = (WINDOW_HEIGHT - height) / 2
+
+    # By default lines are half as long as the average spacing between them.
+    length = args.length
+    if length is None:
+        length = 0.5 * math.sqrt(width * height / args.lines)
+
+    out.write("%d\n" % args.lines)
+    for _ in range(args.lines):
+        l = min(sample(rng, args.length_dist, length), width, height)
+        angle = rng.uniform(0, math.pi)
+        dx = l * math.cos(angle)
+        dy = l * math.sin(angle)
+
+        x1 = rng.uniform(x0 + max(0.0, -dx), x0 + width - max(0.0, dx))
+        y1 = rng.uniform(y0, y0 + height - dy)
+
+        speed = sample(rng, args.speed_dist, args.speed)
+        heading = rng.uniform(0, 2 * math.pi)
+        vx = speed * math.cos(heading)
+        vy = speed * math.sin(heading)
+
+        color = 1 if rng.random() < args.gray else 0
+        out.write("(%f, %f), (%f, %f), %f, %f, %d\n"
+                  % (x1, y1, x1 + dx, y1 + dy, vx, vy, color))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate a screensaver scene.")
+    parser.add_argument("-n", "--lines", type=int, default=10000,
+                        help="number of lines (default 10000)")
+    parser.add_argument("--density", type=float, default=1.0,
+                        help="fraction of the window the lines are spread "
+                        "over, in (0, 1] (default 1)")
+    parser.add_argument("--length", type=float, default=None,
+                        help="mean line length in pixels (default: half "
+                        "the mean spacing between lines)")
+    parser.add_argument("--length-dist", default="uniform",
+                        choices=["fixed", "uniform", "exp", "normal"],
+                        help="line length distribution (default uniform)")
+    parser.add_argument("--speed", type=float, default=1.0,
+                        help="mean speed in pixels per time step (default 1)")
+    parser.add_argument("--speed-dist", default="uniform",
+                        choices=["fixed", "uniform", "exp", "normal"],
+                        help="speed distribution (default uniform)")
+    parser.add_argument("--gray", type=float, default=0.5,
+                        help="fraction of gray lines (default 0.5)")
+    parser.add_argument("--seed", type=int, default=6172,
+                        help="random seed (default 6172)")
+    parser.add_argument("-o", "--output", default="-",
+                        help="output file (default stdout)")
+    args = parser.parse_args()
+
+    if args.lines <= 0:
+        parser.error("--lines must be positive")
+    if not 0 < args.density <= 1:
+        parser.error("--density must be in (0, 1]")
+
+    if args.output == "-":
+        generate(args, sys.stdout)
+    else:
+        with open(args.output, "w") as out:
+            generate(args, out)
+
+
+if __name__ == "__main__":
+    main()
@@ -20,8 +20,10 @@
  * SOFTWARE.
  **/
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <cilk/cilk.h>
 
@@ -29,6 +31,7 @@
 #include "./fasttime.h"
 #include "./line.h"
 #include "./line_demo.h"
+#include "./batch.h"
 #include "./cilktool.h"
 
 // The PROFILE_BUILD preprocessor define is used to indicate we are building for
@@ -37,6 +40,7 @@
 #include "./graphic_stuff.h"
 #endif
 static char* DEFAULT_INPUT_FILE_PATH = "input/mit.in";
+static char* DEFAULT_CHECKPOINT_FILE_PATH = "screensaver.ckpt";
 static char* input_file_path;
 
 // For non-graphic version
@@ -55,16 +59,68 @@ int main(int argc, char *argv[]) {
   bool graphicDemoFlag = false;
 #endif
   unsigned int numFrames = 1;
+  unsigned int statsInterval = 0;
+  unsigned int checkpointInterval = 0;
+  char* checkpoint_file_path = DEFAULT_CHECKPOINT_FILE_PATH;
+  char* resume_file_path = NULL;
+  char* profile_file_path = NULL;
+  double timeStep = 0;
+  bool eventDriven = false;
+  bool batchFlag = false;
+  BroadPhase broadPhase = BROAD_PHASE_QUADTREE;
+  unsigned int autotuneFrames = 0;
+  bool pairCache = false;
   extern int optind;
 
   // Process command line options.
-  while ((optchar = getopt(argc, argv, "gi")) != -1) {
+  while ((optchar = getopt(argc, argv, "gis:c:o:r:t:ep:bm:a:k")) != -1) {
     switch (optchar) {
       case 'g':
 #ifndef PROFILE_BUILD
         graphicDemoFlag = true;
 #endif
         break;
+      case 's':
+        statsInterval = atoi(optarg);
+        break;
+      case 'c':
+        checkpointInterval = atoi(optarg);
+        break;
+      case 'o':
+        checkpoint_file_path = optarg;
+        break;
+      case 'r':
+        resume_file_path = optarg;
+        break;
+      case 't':
+        timeStep = atof(optarg);
+        break;
+      case 'e':
+        eventDriven = true;
+        break;
+      case 'p':
+        profile_file_path = optarg;
+        break;
+      case 'b':
+        batchFlag = true;
+        break;
+      case 'm':
+        if (strcmp(optarg, "bvh") == 0) {
+          broadPhase = BROAD_PHASE_BVH;
+        } else if (strcmp(optarg, "quadtree") == 0) {
+          broadPhase = BROAD_PHASE_QUADTREE;
+        } else if (strcmp(optarg, "loose") == 0) {
+          broadPhase = BROAD_PHASE_LOOSE_QUADTREE;
+        } else {
+          printf("Ignoring unknown broad phase: %s\n", optarg);
+        }
+        break;
+      case 'a':
+        autotuneFrames = atoi(optarg);
+        break;
+      case 'k':
+        pairCache = true;
+        break;
       default:
         printf("Ignoring unrecognized option: %c\n", optchar);
         continue;
@@ -79,14 +135,40 @@ int main(int argc, char *argv[]) {
 
   // Check to make sure number of arguments is correct.
   if (remaining_args < 1) {
-    printf("Usage: %s [-g] <numFrames> [inputfile]\n", argv[0]);
+    printf("Usage: %s [-g] [-s N] [-c N] [-o FILE] [-r FILE] [-t STEP] [-e] "
+           "[-p FILE] [-m NAME] [-a N] [-k] <numFrames> [inputfile]\n",
+           argv[0]);
+    printf("       %s -b [-t STEP] [-e] [-m NAME] <numFrames> "
+           "<inputfile>...\n", argv[0]);
     printf("  -g : show graphics\n");
+    printf("  -s N : print broad-phase statistics every N frames\n");
+    printf("  -c N : checkpoint every N frames\n");
+    printf("  -o FILE : checkpoint file (default %s)\n",
+           DEFAULT_CHECKPOINT_FILE_PATH);
+    printf("  -r FILE : resume from a checkpoint of the same input file\n");
+    printf("  -t STEP : simulated time per frame (default 0.5)\n");
+    printf("  -e : resolve collisions in time order within each frame\n");
+    printf("  -p FILE : write per-frame phase timings as CSV\n");
+    printf("  -b : simulate all the input files concurrently\n");
+    printf("  -m NAME : broad phase, quadtree (default), loose (loose "
+           "quadtree) or bvh\n");
+    printf("  -a N : tune the quadtree on the next N frames before running\n");
+    printf("  -k : skip the pair test for pairs that cannot collide yet\n");
     exit(-1);
   }
 
   numFrames = atoi(argv[1]);
   printf("Number of frames = %u\n", numFrames);
 
+  if (batchFlag) {
+    if (remaining_args < 2) {
+      fprintf(stderr, "No input files\n");
+      exit(-1);
+    }
+    return Batch_run(argv + 2, remaining_args - 1, numFrames, timeStep,
+                     eventDriven, broadPhase) == 0 ? 0 : 1;
+  }
+
   if (remaining_args > 1) {
     input_file_path = argv[2];
   } else {
@@ -99,6 +181,28 @@ int main(int argc, char *argv[]) {
   LineDemo_setInputFile(input_file_path);
   LineDemo_initLine(lineDemo);
   LineDemo_setNumFrames(lineDemo, numFrames);
+  if (timeStep > 0) {
+    LineDemo_setTimeStep(lineDemo, timeStep);
+  }
+  LineDemo_setEventDriven(lineDemo, eventDriven);
+  LineDemo_setBroadPhase(lineDemo, broadPhase);
+  LineDemo_setPairCache(lineDemo, pairCache);
+  if (profile_file_path != NULL) {
+    LineDemo_enableProfile(lineDemo);
+  }
+  LineDemo_setStatsInterval(lineDemo, statsInterval);
+  LineDemo_setCheckpoint(lineDemo, checkpointInterval, checkpoint_file_path);
+  if (resume_file_path != NULL) {
+    if (LineDemo_resume(lineDemo, resume_file_path) != 0) {
+      fprintf(stderr, "Could not resume from checkpoint (%s)\n",
+              resume_file_path);
+      exit(1);
+    }
+    printf("Resuming after frame %u\n", lineDemo->count);
+  }
+  if (autotuneFrames > 0) {
+    LineDemo_autotune(lineDemo, autotuneFrames);
+  }
 
   const fasttime_t start_time = gettime();
 
@@ -123,8 +227,15 @@ int main(int argc, char *argv[]) {
          LineDemo_getNumLineWallCollisions(lineDemo));
   printf("%u Line-Line Collisions\n",
          LineDemo_getNumLineLineCollisions(lineDemo));
+  printf("%" PRIu64 " Candidate Pairs Tested\n",
+         LineDemo_getNumCandidatePairs(lineDemo));
   printf("---- END RESULTS ----\n");
 
+  if (profile_file_path != NULL
+      && LineDemo_writeProfile(lineDemo, profile_file_path) != 0) {
+    fprintf(stderr, "Could not write profile (%s)\n", profile_file_path);
+  }
+
   // delete objects
   LineDemo_delete(lineDemo);
 #ifdef CILKSCALE
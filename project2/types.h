@@ -10,32 +10,102 @@ struct Bounds {
 };
 typedef struct Bounds Bounds;
 
-struct vector {
-    void **data;
-    void **empty;
-    int size;
+struct QuadTreeNode {
+    Bounds bounds;
+
+    // bounds scaled about their center by the tree's looseness.  Lines are
+    // placed and searched for by these.
+    Bounds loose;
+
+    // Index of the first of the four children (nw, ne, se, sw) in the
+    // node arena, or -1 if the node is a leaf.
+    int children;
+    int parent;
+
+    int current_depth;
+
+    // Lines that fit in this node but in none of its children:
+    // lines[offset, offset + count) of the tree's line buffer.
+    int offset;
     int count;
 };
-typedef struct vector vector;
+typedef struct QuadTreeNode QuadTreeNode;
+
+// Tuning parameters of a quadtree.
+struct QuadTreeParams {
+    // Leaves holding more lines than maxLines are split, unless they are
+    // maxDepth deep.
+    int maxLines;
+    int maxDepth;
+    // The children of nodes shallower than parallelDepth are searched in
+    // parallel.
+    int parallelDepth;
+};
+typedef struct QuadTreeParams QuadTreeParams;
 
 struct QuadTree {
-    Bounds bounds;
-    bool isLeaf;
+    // Node arena.  The root is nodes[0]; siblings are stored next to
+    // each other.
+    QuadTreeNode* nodes;
+    int numNodes;
+    int nodeCapacity;
 
-    //children
-    //nw, ne, se, sw
-    struct QuadTree* children[4];
+    // First nodes of sibling groups freed by merging, reused by splits.
+    int* freeGroups;
+    int numFreeGroups;
+    int freeCapacity;
 
-    // LinkedList of nodes in the head that:
-    //     are not splitted if line_count <= 4
-    //     or
-    //     can't be splitted
-    vector* nodes;
+    // Number of calls to QuadTree_update so far.
+    int updates;
 
-    struct QuadTree* parent;
+    // Factor the node bounds are enlarged by; 1 for a strict quadtree.
+    double looseness;
 
-    int current_depth;
+    QuadTreeParams params;
+
+    // Line buffer, grouped by node.  Rebuilt every frame.
+    struct Line** lines;
+
+    // Index of the node holding each line, in the order the lines are
+    // passed to QuadTree_update.
+    int* line_node;
+    int numLines;
+    int lineCapacity;
 };
 typedef struct QuadTree QuadTree;
 
+struct BVHNode {
+    Bounds bounds;
+
+    // The left child is the next node in the arena; right is the index of
+    // the right child, or -1 if the node is a leaf.
+    int right;
+
+    // Lines under this node: lines[start, start + count) of the tree's
+    // line buffer.
+    int start;
+    int count;
+};
+typedef struct BVHNode BVHNode;
+
+struct BVH {
+    // Node arena in depth-first order, so every node comes before its
+    // children.  The root is nodes[0].
+    BVHNode* nodes;
+    int numNodes;
+    int nodeCapacity;
+
+    // Line buffer, grouped by leaf.  Only reordered by a rebuild.
+    struct Line** lines;
+    int numLines;
+    int lineCapacity;
+
+    // Total area of the internal nodes after the last rebuild, and the
+    // number of refits since.
+    double builtArea;
+    int refits;
+    int rebuilds;
+};
+typedef struct BVH BVH;
+
 #endif
\ No newline at end of file
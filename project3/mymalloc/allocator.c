@@ -25,7 +25,9 @@
 #include <stdlib.h>  
 #include <string.h>  
 #include "./allocator_interface.h"  
+#include "./config.h"
 #include "./memlib.h"  
+#include "./size_classes.h"
 #include <stdbool.h>  
   
 // Don't call libc malloc!  
@@ -77,8 +79,9 @@ HEADER_TYPE get_block_size_head(void* hp) {
 #define get_footer_from_head(hp) ((char*)hp + (get_block_size_head(hp) - FOOTER_T_SIZE))
 #define set_footer_size(p, n) (*((HEADER_TYPE*)get_footer_from_head(p)) = n)
 
+// Sets the size of the block at hp and marks it free.
 void set_block_size_head(void* hp, uint64_t n) {
-  *((HEADER_TYPE*)hp) = n | ( ( (*((HEADER_TYPE*)hp) & CLEAN_BIT) ) & NODE_BIT );
+  *((HEADER_TYPE*)hp) = n;
   set_footer_size(hp, n);
   assert(get_block_size_head(hp) == *((HEADER_TYPE*)get_footer_from_head(hp)));
 }
@@ -124,6 +127,7 @@ int JOINS = 0;
 
 void* coalesce_neighbors(void* p);
 void* allocate_from_top(size_t size);
+void init_slabs();
 
 void* get_top() {
   void* last_block_footer = ((char*)mem_heap_hi() - 3);
@@ -148,14 +152,27 @@ uint64_t round_down(size_t v){
 #define MIN_POWER (4)
 #define MAX_POWER (31)
 
-#define is_list(p) (p < FREE_LIST_END)
+// Each power of 2 is split into SUB_BINS bins of equal width, so a block in
+// a bin is within 1 / SUB_BINS of the size of any other block in it.
+#ifndef SUB_BIN_BITS
+  #define SUB_BIN_BITS 3
+#endif
+#define SUB_BINS (1 << SUB_BIN_BITS)
 
-#define NUM_BINS (MAX_POWER - MIN_POWER + 1)
+#define NUM_POWERS (MAX_POWER - MIN_POWER + 1)
+#define NUM_BINS (NUM_POWERS * SUB_BINS)
 
 free_node_t FREE_LIST[NUM_BINS];
 
 #define FREE_LIST_END ((free_node_t*)FREE_LIST + NUM_BINS)
 
+#define is_list(p) ((free_node_t*)(p) >= FREE_LIST && (free_node_t*)(p) < FREE_LIST_END)
+
+// A bit for every power with a non-empty bin, and for every power, a bit
+// for each of its non-empty bins.
+uint32_t POWER_MAP;
+uint32_t SUB_MAP[NUM_POWERS];
+
 #define POWER_TWO(value) ((value == 0)^(value == (value & -value)))
 // #define POWER_TWO(v) (v && !(v & (v - 1)))
 
@@ -187,6 +204,10 @@ int my_init() {
     list->next = NULL;
     list = (char*)list + sizeof(free_node_t);
   }
+  POWER_MAP = 0;
+  memset(SUB_MAP, 0, sizeof(SUB_MAP));
+
+  init_slabs();
 
   return 0;
 }
@@ -195,8 +216,8 @@ void print_freelist(){
     free_node_t* curr_list = FREE_LIST;
     free_node_t* prev_list = NULL;
     printf("HEAD -> ");
-    uint16_t last_power = MIN_POWER;
-    while(curr_list!= NULL && curr_list < FREE_LIST_END && last_power < MAX_POWER){ 
+    uint64_t last_bin = 0;
+    while(curr_list!= NULL && curr_list < FREE_LIST_END){ 
         int num_nodes = 0;
         free_node_t* curr_node = curr_list->next;
         free_node_t* prev_node = curr_list;
@@ -207,17 +228,34 @@ void print_freelist(){
             curr_node = curr_node->next;
         }
 
-        if (num_nodes) printf("(Power: %i  Nodes: %i) ->", last_power, num_nodes);
+        if (num_nodes) printf("(Power: %lu.%lu  Nodes: %i) ->", last_bin / SUB_BINS + MIN_POWER, last_bin % SUB_BINS, num_nodes);
         prev_list = curr_list;
         curr_list++;
-        last_power++;
+        last_bin++;
     }
     printf(" END\n\n");
 }
 
-free_node_t* find_bin(uint64_t power) {
-  assert(MIN_POWER <= power && power <= MAX_POWER);
-  return &FREE_LIST[power - MIN_POWER];
+// The index of the bin holding blocks of the given size.
+uint64_t bin_of(uint64_t size) {
+  uint64_t power = MAX(round_down(size), MIN_POWER);
+  assert(power <= MAX_POWER);
+  uint64_t sub = (size >> (power - SUB_BIN_BITS)) & (SUB_BINS - 1);
+  return (power - MIN_POWER) * SUB_BINS + sub;
+}
+
+// The index of the first non-empty bin at or after index, or NUM_BINS.
+uint64_t find_nonempty_bin(uint64_t index) {
+  if (index >= NUM_BINS) return NUM_BINS;
+  uint64_t power = index / SUB_BINS;
+  uint32_t subs = SUB_MAP[power] & (~0U << (index % SUB_BINS));
+  if (subs == 0) {
+    uint32_t powers = POWER_MAP & (~1U << power);
+    if (powers == 0) return NUM_BINS;
+    power = __builtin_ctz(powers);
+    subs = SUB_MAP[power];
+  }
+  return power * SUB_BINS + __builtin_ctz(subs);
 }
 
 void insert_to_bin(free_node_t* bin, void* p) {
@@ -226,37 +264,40 @@ void insert_to_bin(free_node_t* bin, void* p) {
   free_node_t* node = p;
 
   if (bin->next == NULL) {
-    bin->next = node;
-    node->next = NULL;
-    node->prev = bin;
-    return;
+    uint64_t index = bin_index(bin);
+    SUB_MAP[index / SUB_BINS] |= 1U << (index % SUB_BINS);
+    POWER_MAP |= 1U << (index / SUB_BINS);
   }
+  node->next = bin->next;
+  node->prev = bin;
+  if (bin->next) bin->next->prev = node;
+  bin->next = node;
+}
 
-  free_node_t* head = bin->next;
-  assert(head != NULL);
+// Unlinks node from its bin, marking the bin empty if it was the last node.
+void unlink_node(free_node_t* node) {
+  assert(node->prev != NULL);
 
-  // TODO fix?
-  while (head->next != NULL && get_block_size_data(head) < get_block_size_data(node)) {
-    head = head->next;
+  node->prev->next = node->next;
+  if (node->next) {
+    node->next->prev = node->prev;
+  } else if (is_list(node->prev)) {
+    uint64_t index = bin_index(node->prev);
+    SUB_MAP[index / SUB_BINS] &= ~(1U << (index % SUB_BINS));
+    if (SUB_MAP[index / SUB_BINS] == 0) {
+      POWER_MAP &= ~(1U << (index / SUB_BINS));
+    }
   }
-
-  assert(head != NULL);
-  
-  bin->next  = node;
-  node->next = head;
-  if (head->next) head->next->prev = head;
-  head->prev = node;
-  node->prev = bin;
 }
 
-void insert_free_node(uint64_t power, void * p){
+// Puts the free block with data pointer p in the bin for its size.
+void insert_free_node(void * p){
     #ifdef PRINT
-        printf("Inserting: power: %i    --- ", power);
+        printf("Inserting: size: %u    --- ", get_block_size_data(p));
         print_freelist();
     #endif
 
-    free_node_t* bin = find_bin(power);
-    insert_to_bin(bin, p);
+    insert_to_bin(&FREE_LIST[bin_of(get_block_size_data(p))], p);
 }
 
 void* slice_free_node(free_node_t * node, uint64_t required_size){
@@ -279,7 +320,7 @@ void* slice_free_node(free_node_t * node, uint64_t required_size){
     set_block_size_head(next_ptr, required_size);
     set_clean((char*)p + HEADER_T_SIZE);
     //insert the node
-    insert_free_node(round_down(new_size), (char *)p + HEADER_T_SIZE);
+    insert_free_node((char *)p + HEADER_T_SIZE);
 
     assert(start <= p && p <= mem_heap_hi());
 
@@ -336,15 +377,13 @@ free_node_t* pop_node_from_bin(free_node_t* bin) {
   assert(bin->next != NULL);
 
   free_node_t* to_return = bin->next;
-  bin->next = bin->next->next;
-  if (bin->next) bin->next->prev = bin;
-
+  unlink_node(to_return);
   return to_return;
 }
 
-free_node_t* pop_node_from_bin_same_power(free_node_t* bin, size_t size) {
+// The first node of bin with room for size bytes, or NULL.
+free_node_t* pop_node_from_bin_fitting(free_node_t* bin, size_t size) {
   assert(is_list(bin));
-  assert(bin->next != NULL);
 
   free_node_t* head = bin->next;
   while (head != NULL) {
@@ -353,36 +392,250 @@ free_node_t* pop_node_from_bin_same_power(free_node_t* bin, size_t size) {
   }
 
   if (head == NULL) return NULL;
-  head->prev->next = head->next;
-  if (head->next) head->next->prev = head->prev;
-
+  unlink_node(head);
   return head;
 }
 
-free_node_t* find_next_nonempty_bin(free_node_t* bin) {
-  bin++;
-  while (bin->next == NULL && bin <= FREE_LIST_END) {
-      bin++;
+// Any block in a bin past the one size falls in is large enough, so the
+// first of them is a good fit.  Blocks in the bin of size itself may be too
+// small, and are only searched when there are no larger ones.
+void * pop_free_list(size_t size){
+  uint64_t bin = bin_of(size);
+  uint64_t larger = find_nonempty_bin(bin + 1);
+
+  if (larger < NUM_BINS) {
+    return slice_free_node(pop_node_from_bin(&FREE_LIST[larger]), size);
   }
 
-  return is_list(bin) ? bin : NULL;
+  free_node_t* p = pop_node_from_bin_fitting(&FREE_LIST[bin], size);
+  return (p == NULL) ? allocate_from_top(size) : slice_free_node(p, size);
 }
 
-void * pop_free_list(size_t size){
-  uint64_t power = round_down(size);
-  free_node_t* bin = find_bin(power);
+// Small requests are served from slabs: SLAB_SIZE-aligned pages cut out of
+// the heap as used blocks, and split into equal slots without headers.  The
+// slab of a slot is found by masking its address, and a bit for every page
+// of the heap tells slab slots from ordinary blocks.
+//
+// Past 128 bytes, rounding up to a class wastes more than the header and
+// footer of a block, and so do larger pages on classes with few blocks,
+// hence the defaults.  Utilization on traces/ with 2 KiB slabs was 92.4,
+// 92.5, 91.9, 89.4 and 83.4 for SLAB_MAX_SIZE 64 to 1024, against 88.8
+// without slabs.
+#ifndef SLAB_SHIFT
+  #define SLAB_SHIFT 11
+#endif
+#define SLAB_SIZE (1ULL << SLAB_SHIFT)
+#ifndef SLAB_MAX_SIZE
+  #define SLAB_MAX_SIZE 128
+#endif
+
+// Slot sizes are 8 bytes apart, then as in size_classes.h.
+#define MAX_CLASSES 28
+// Enough bits for slots of 8 bytes.
+#define SLAB_BITMAP_WORDS (SLAB_SIZE / 8 / 64)
+
+typedef struct slab_t {
+  struct slab_t* next;  // slabs of the class with free slots
+  struct slab_t* prev;
+  uint32_t size;        // of a slot
+  uint16_t class;
+  uint16_t num_slots;
+  uint32_t num_used;
+  uint64_t free_slots[SLAB_BITMAP_WORDS];  // a set bit marks a free slot
+} slab_t;
+
+#define SLAB_HEADER_SIZE ALIGN(sizeof(slab_t))
+// The slots end before the footer of the slab's block and the header of
+// the block after it.
+#define SLAB_SLOT_BYTES (SLAB_SIZE - SLAB_HEADER_SIZE - HEADER_T_SIZE - FOOTER_T_SIZE)
+
+#define slab_of(p) ((slab_t*)((uint64_t)(p) & ~(SLAB_SIZE - 1)))
+
+uint32_t CLASS_SIZE[MAX_CLASSES];
+// Class of each request size, indexed by (size + 7) / 8.
+uint8_t CLASS_OF[SLAB_MAX_SIZE / 8 + 1];
+int NUM_CLASSES;
+
+slab_t* PARTIAL_SLABS[MAX_CLASSES];
+
+// A bit for every page of the heap, set for slabs.  Thread caches look a
+// block's page up without the heap lock while other pages of the same word
+// change under it, so every access is atomic.  The bit of a live block's
+// page does not change until the block is freed, so relaxed order does.
+uint64_t SLAB_PAGES[(MAX_HEAP >> SLAB_SHIFT) / 64 + 2];
+uint64_t FIRST_PAGE;
+
+void setup_classes() {
+  NUM_CLASSES = size_classes_make(CLASS_SIZE, 8, SLAB_MAX_SIZE);
+  assert(NUM_CLASSES <= MAX_CLASSES);
+  assert(SLAB_SLOT_BYTES / CLASS_SIZE[0] <= 64 * SLAB_BITMAP_WORDS);
+  size_classes_index(CLASS_OF, CLASS_SIZE, 8, SLAB_MAX_SIZE);
+}
+
+void init_slabs() {
+  if (NUM_CLASSES == 0) {
+    setup_classes();
+  }
+  for (int c = 0; c < NUM_CLASSES; c++) {
+    PARTIAL_SLABS[c] = NULL;
+  }
+  memset(SLAB_PAGES, 0, sizeof(SLAB_PAGES));
+  FIRST_PAGE = (uint64_t)mem_heap_lo() >> SLAB_SHIFT;
+}
+
+static inline bool is_slab(void* p) {
+  uint64_t page = ((uint64_t)p >> SLAB_SHIFT) - FIRST_PAGE;
+  uint64_t word = __atomic_load_n(&SLAB_PAGES[page / 64], __ATOMIC_RELAXED);
+  return (word >> (page % 64)) & 1;
+}
+
+static inline void set_slab_page(void* p, bool slab) {
+  uint64_t page = ((uint64_t)p >> SLAB_SHIFT) - FIRST_PAGE;
+  if (slab) {
+    __atomic_fetch_or(&SLAB_PAGES[page / 64], 1ULL << (page % 64),
+                      __ATOMIC_RELAXED);
+  } else {
+    __atomic_fetch_and(&SLAB_PAGES[page / 64], ~(1ULL << (page % 64)),
+                       __ATOMIC_RELAXED);
+  }
+}
 
-  if (bin->next != NULL) {
-    free_node_t* p = pop_node_from_bin_same_power(bin, size);
-    if (p != NULL) {
-      return p;
+// The first SLAB_SIZE boundary a slab can start at in a free block at h,
+// leaving either nothing or a block of at least MIN_SIZE before it.
+char* slab_start(char* h) {
+  char* a = (char*)(((uint64_t)h + HEADER_T_SIZE + SLAB_SIZE - 1) & ~(SLAB_SIZE - 1));
+  uint64_t front = a - HEADER_T_SIZE - h;
+  if (front != 0 && front < MIN_SIZE) {
+    a += SLAB_SIZE;
+  }
+  return a;
+}
+
+// Makes a used block with its data at a out of the free space from h to
+// end, which is not in any bin, and frees what is left on either side.
+void* place_slab(char* h, char* a, char* end) {
+  char* hp = a - HEADER_T_SIZE;
+  char* slab_end = hp + SLAB_SIZE;
+  assert(h <= hp && slab_end <= end);
+
+  if (hp > h) {
+    set_block_size_head(h, hp - h);
+    insert_free_node(h + HEADER_T_SIZE);
+  }
+  uint64_t back = end - slab_end;
+  if (back >= MIN_SIZE) {
+    set_block_size_head(slab_end, back);
+    insert_free_node(slab_end + HEADER_T_SIZE);
+    back = 0;
+  }
+  set_block_size_head(hp, SLAB_SIZE + back);
+  set_dirty(a);
+  return a;
+}
+
+// Cuts a block for a slab out of the heap.  Returns its data, which starts
+// at a SLAB_SIZE boundary.
+void* carve_slab() {
+  // The first block of a large enough bin may have room for it.
+  for (uint64_t bin = find_nonempty_bin(bin_of(SLAB_SIZE)); bin < NUM_BINS;
+       bin = find_nonempty_bin(bin + 1)) {
+    char* h = (char*)FREE_LIST[bin].next - HEADER_T_SIZE;
+    char* a = slab_start(h);
+    char* end = h + get_block_size_head(h);
+    if (a - HEADER_T_SIZE + SLAB_SIZE <= end) {
+      remove_block(h);
+      return place_slab(h, a, end);
     }
   }
 
-  bin = find_next_nonempty_bin(bin);
-  assert(bin == NULL || bin->next != NULL);
+  // Otherwise put it at the top of the heap, taking in the last block if it
+  // is free.
+  char* end = (char*)mem_heap_hi() + 1;
+  char* h = end;
+  if (end > (char*)start) {
+    char* last = get_top();
+    if (!is_dirty(last + HEADER_T_SIZE)) {
+      remove_block(last);
+      h = last;
+    }
+  }
+  char* a = slab_start(h);
+  char* slab_end = a - HEADER_T_SIZE + SLAB_SIZE;
+  if (slab_end > end) {
+    mem_sbrk(slab_end - end);
+    end = slab_end;
+  }
+  return place_slab(h, a, end);
+}
 
-  return (bin == NULL) ? allocate_from_top(size) : slice_free_node(pop_node_from_bin(bin), size);
+slab_t* new_slab(int c) {
+  slab_t* slab = carve_slab();
+  set_slab_page(slab, true);
+
+  slab->size = CLASS_SIZE[c];
+  slab->class = c;
+  slab->num_slots = SLAB_SLOT_BYTES / slab->size;
+  slab->num_used = 0;
+  for (int w = 0; w < SLAB_BITMAP_WORDS; w++) {
+    int bits = slab->num_slots - 64 * w;
+    slab->free_slots[w] = bits >= 64 ? ~0ULL : bits > 0 ? (1ULL << bits) - 1 : 0;
+  }
+
+  slab->prev = NULL;
+  slab->next = PARTIAL_SLABS[c];
+  if (slab->next) slab->next->prev = slab;
+  PARTIAL_SLABS[c] = slab;
+  return slab;
+}
+
+void unlink_slab(slab_t* slab) {
+  if (slab->prev) {
+    slab->prev->next = slab->next;
+  } else {
+    PARTIAL_SLABS[slab->class] = slab->next;
+  }
+  if (slab->next) slab->next->prev = slab->prev;
+}
+
+void* slab_malloc(int c) {
+  slab_t* slab = PARTIAL_SLABS[c];
+  if (slab == NULL) {
+    slab = new_slab(c);
+  }
+
+  int w = 0;
+  while (slab->free_slots[w] == 0) {
+    w++;
+  }
+  int slot = 64 * w + __builtin_ctzll(slab->free_slots[w]);
+  slab->free_slots[w] &= slab->free_slots[w] - 1;
+
+  if (++slab->num_used == slab->num_slots) {
+    unlink_slab(slab);
+  }
+  return (char*)slab + SLAB_HEADER_SIZE + slot * slab->size;
+}
+
+void slab_free(void* p) {
+  slab_t* slab = slab_of(p);
+  uint32_t slot = ((char*)p - (char*)slab - SLAB_HEADER_SIZE) / slab->size;
+  assert(!((slab->free_slots[slot / 64] >> (slot % 64)) & 1));
+  slab->free_slots[slot / 64] |= 1ULL << (slot % 64);
+
+  if (slab->num_used-- == slab->num_slots) {
+    slab->prev = NULL;
+    slab->next = PARTIAL_SLABS[slab->class];
+    if (slab->next) slab->next->prev = slab;
+    PARTIAL_SLABS[slab->class] = slab;
+  }
+
+  // Give an empty slab back to the heap, unless it is the last one of its
+  // class.
+  if (slab->num_used == 0 && (slab->prev || slab->next)) {
+    unlink_slab(slab);
+    set_slab_page(slab, false);
+    my_free(slab);
+  }
 }
 
 //  malloc - Allocate a block by incrementing the brk pointer.
@@ -392,6 +645,10 @@ void* my_malloc(size_t size) {
     ACTIONS++;
   #endif
 
+  if (size <= SLAB_MAX_SIZE) {
+    return slab_malloc(CLASS_OF[(size + 7) / 8]);
+  }
+
   size_t aligned_size = MAX(ALIGN(size + HEADER_T_SIZE + FOOTER_T_SIZE), MIN_SIZE);
 
   void* p = pop_free_list(aligned_size);
@@ -407,14 +664,53 @@ void my_free(void* p) {
     ACTIONS++;
     FREES++;
   #endif
+  if (is_slab(p)) {
+    slab_free(p);
+    return;
+  }
+
   /* add to free list with different size now! */
   set_clean(p);
   assert(!is_dirty(p));
   assert(!is_list(p));
 
   p = coalesce_neighbors((char*)p - HEADER_T_SIZE);
-  uint64_t power = MAX(round_down(get_block_size_data(p)), MIN_POWER); //lower bounds the power
-  insert_free_node(power, p);
+  insert_free_node(p);
+}
+
+size_t my_usable_size(void* ptr) {
+  if (is_slab(ptr)) {
+    return slab_of(ptr)->size;
+  }
+  return get_block_size_data(ptr) - HEADER_T_SIZE - FOOTER_T_SIZE;
+}
+
+// Shrinks the used block at data pointer p to size bytes, keeping its
+// front and freeing the rest.
+void* trim_block(void* p, uint64_t size) {
+  void* hp = (char*)p - HEADER_T_SIZE;
+  uint64_t rest = get_block_size_head(hp) - size;
+  if (rest >= MIN_SIZE) {
+    set_block_size_head(hp, size);
+    set_dirty(p);
+    void* tail = next_block(hp);
+    set_block_size_head(tail, rest);
+    tail = coalesce_neighbors(tail);
+    insert_free_node(tail);
+  }
+  return p;
+}
+
+// A block that realloc grows gets up to 1 / 2^REALLOC_SLACK_SHIFT of its
+// size to spare, so that the next few reallocs find it large enough.
+#ifndef REALLOC_SLACK_SHIFT
+  #define REALLOC_SLACK_SHIFT 5
+#endif
+
+// Trims the used block at data pointer p down to slack_size bytes, if it is
+// larger.
+void* keep_slack(void* p, uint64_t slack_size) {
+  return get_block_size_data(p) > slack_size ? trim_block(p, slack_size) : p;
 }
 
 //#define PRINT_REALLOC
@@ -427,12 +723,22 @@ void * my_realloc(void *ptr, size_t size) {
   printf("reallocating...%ld to size: %i\n", ptr, size);
   #endif
 
+  if (is_slab(ptr)) {
+    uint32_t slot_size = slab_of(ptr)->size;
+    if (size <= slot_size) {
+      return ptr;
+    }
+    void* new_ptr = my_malloc(size);
+    memcpy(new_ptr, ptr, slot_size);
+    slab_free(ptr);
+    return new_ptr;
+  }
+
   size_t aligned_size = MAX(ALIGN(size + HEADER_T_SIZE + FOOTER_T_SIZE), MIN_SIZE);
+  size_t slack_size = ALIGN(aligned_size + (aligned_size >> REALLOC_SLACK_SHIFT));
   
   if(get_block_size_data(ptr) >=  aligned_size){
-    // remove_block((char*)ptr - HEADER_T_SIZE);
-    ptr = slice_free_node(ptr, aligned_size);
-    return ptr;
+    return keep_slack(ptr, slack_size);
   }
 
   ptr = (char*)ptr - HEADER_T_SIZE;
@@ -446,22 +752,42 @@ void * my_realloc(void *ptr, size_t size) {
     next_block_data = (char*)next_block(ptr) + HEADER_T_SIZE;
   }
   
+  bool at_top = next_block(ptr) >= mem_heap_hi() - HEADER_T_SIZE;
   ptr = (char*)ptr + HEADER_T_SIZE;
+  set_dirty(ptr);
 
   if(get_block_size_data(ptr) >= aligned_size){
-      // remove_block((char*)ptr - HEADER_T_SIZE);
-      ptr = slice_free_node(ptr, aligned_size);
-      return ptr;
+      return keep_slack(ptr, slack_size);
+  }
+
+  size_t old_size = get_block_size_data(ptr) - HEADER_T_SIZE - FOOTER_T_SIZE;
+
+  // Move down into a free block before it, if that makes enough room or
+  // the block can then be grown at the top of the heap.
+  void* hp = (char*)ptr - HEADER_T_SIZE;
+  if ((uint64_t)hp > start && !is_dirty((char*)prev_block(hp) + HEADER_T_SIZE)) {
+    void* t = prev_block(hp);
+    if (at_top || get_block_size_head(t) + get_block_size_head(hp) >= aligned_size) {
+      remove_block(t);
+      join(t, hp);
+      memmove((char*)t + HEADER_T_SIZE, ptr, old_size);
+      ptr = (char*)t + HEADER_T_SIZE;
+      set_dirty(ptr);
+      if(get_block_size_data(ptr) >= aligned_size){
+        return keep_slack(ptr, slack_size);
+      }
+    }
+  }
+
+  // Grow the last block of the heap in place.
+  if (at_top && mem_sbrk(slack_size - get_block_size_data(ptr)) != (void*)-1) {
+    set_block_size_data(ptr, slack_size);
+    set_dirty(ptr);
+    return ptr;
   }
 
-  // if((char*)ptr + get_block_size_data(ptr) >= mem_heap_hi()-1){
-  //     mem_sbrk(aligned_size - get_block_size_data(ptr));
-  //     set_block_size_data(ptr, aligned_size);
-  //     return ptr;
-  // }
-    
   void* new_ptr = my_malloc(size);
-  memcpy(new_ptr, ptr, size);
+  memcpy(new_ptr, ptr, old_size < size ? old_size : size);
   my_free(ptr);
 
   return new_ptr;
@@ -505,11 +831,7 @@ void* coalesce_neighbors(void* p) {
 
 //assumes p is at very start of block (before size)
 void remove_block(void* p) {
-  free_node_t* node = (char*)p + HEADER_T_SIZE;
-  assert(node->prev != NULL);
-
-  node->prev->next = node->next;
-  if (node->next) node->next->prev = node->prev;
+  unlink_node((free_node_t*)((char*)p + HEADER_T_SIZE));
 }
 
 void print_heap(bool show_address) {
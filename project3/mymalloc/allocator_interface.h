@@ -64,6 +64,8 @@ int my_check();
 void my_reset_brk();
 void* my_heap_lo();
 void* my_heap_hi();
+// The number of bytes the caller may use in the block at ptr.
+size_t my_usable_size(void* ptr);
 
 static const malloc_impl_t my_impl = {
   .init = &my_init, .malloc = &my_malloc, .realloc = &my_realloc,
@@ -71,6 +73,41 @@ static const malloc_impl_t my_impl = {
   .heap_lo = &my_heap_lo, .heap_hi = &my_heap_hi
 };
 
+// my_impl behind a single lock, for use from several threads.
+// locked_lock and locked_unlock hold that lock across several calls to the
+// my_* functions, as thread_cache.c does to move a batch of blocks.
+void locked_lock();
+void locked_unlock();
+int locked_init();
+void* locked_malloc(size_t size);
+void* locked_realloc(void* ptr, size_t size);
+void locked_free(void* ptr);
+int locked_check();
+void locked_reset_brk();
+void* locked_heap_lo();
+void* locked_heap_hi();
+
+static const malloc_impl_t locked_impl = {
+  .init = &locked_init, .malloc = &locked_malloc, .realloc = &locked_realloc,
+  .free = &locked_free, .check = &locked_check,
+  .reset_brk = &locked_reset_brk, .heap_lo = &locked_heap_lo,
+  .heap_hi = &locked_heap_hi
+};
+
+// my_impl behind a thread-caching front end, see thread_cache.c.  The
+// heap behind it is locked_impl's.
+int tc_init();
+void* tc_malloc(size_t size);
+void* tc_realloc(void* ptr, size_t size);
+void tc_free(void* ptr);
+
+static const malloc_impl_t tc_impl = {
+  .init = &tc_init, .malloc = &tc_malloc, .realloc = &tc_realloc,
+  .free = &tc_free, .check = &locked_check,
+  .reset_brk = &locked_reset_brk, .heap_lo = &locked_heap_lo,
+  .heap_hi = &locked_heap_hi
+};
+
 int bad_init();
 void* bad_malloc(size_t size);
 void* bad_realloc(void* ptr, size_t size);
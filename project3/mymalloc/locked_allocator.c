@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// The allocator in allocator.c behind a single lock.  The allocator keeps
+// global state and takes no locks, so this is how it can be used from
+// several threads at once.
+
+#include <pthread.h>
+#include "./allocator_interface.h"
+#include "./memlib.h"
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void locked_lock() {
+  pthread_mutex_lock(&heap_lock);
+}
+
+void locked_unlock() {
+  pthread_mutex_unlock(&heap_lock);
+}
+
+int locked_init() {
+  pthread_mutex_lock(&heap_lock);
+  int result = my_init();
+  pthread_mutex_unlock(&heap_lock);
+  return result;
+}
+
+void* locked_malloc(size_t size) {
+  pthread_mutex_lock(&heap_lock);
+  void* p = my_malloc(size);
+  pthread_mutex_unlock(&heap_lock);
+  return p;
+}
+
+void* locked_realloc(void* ptr, size_t size) {
+  pthread_mutex_lock(&heap_lock);
+  void* p = my_realloc(ptr, size);
+  pthread_mutex_unlock(&heap_lock);
+  return p;
+}
+
+void locked_free(void* ptr) {
+  pthread_mutex_lock(&heap_lock);
+  my_free(ptr);
+  pthread_mutex_unlock(&heap_lock);
+}
+
+int locked_check() {
+  pthread_mutex_lock(&heap_lock);
+  int result = my_check();
+  pthread_mutex_unlock(&heap_lock);
+  return result;
+}
+
+void locked_reset_brk() {
+  pthread_mutex_lock(&heap_lock);
+  mem_reset_brk();
+  pthread_mutex_unlock(&heap_lock);
+}
+
+void* locked_heap_lo() {
+  return mem_heap_lo();
+}
+
+// The top of the heap moves under the lock.
+void* locked_heap_hi() {
+  pthread_mutex_lock(&heap_lock);
+  void* hi = mem_heap_hi();
+  pthread_mutex_unlock(&heap_lock);
+  return hi;
+}
@@ -10,7 +10,10 @@
  * May not be used, modified, or copied without permission.
  */
 
+#include <malloc.h>
 #include <math.h>
+#include <pthread.h>
+#include <time.h>
 #include "./mdriver.h"
 #include "./validator.h"
 
@@ -66,6 +69,11 @@ static void eval_libc_speed(trace_t* trace) {
   eval_mm_speed(&libc_impl, trace);
 }
 static int eval_mm_check(const malloc_impl_t* impl, trace_t* trace, int tracenum);
+static void replay_ops(const malloc_impl_t* impl, traceop_t* ops, int num_ops,
+                       char** blocks, const char* where);
+
+/* Routines for replaying the traces in several threads */
+static void eval_mt(trace_t* trace, char* filename, int max_threads);
 
 /* Various helper routines */
 static void printresults(int n, char** tracefiles, stats_t* stats);
@@ -90,6 +98,7 @@ int main(int argc, char** argv) {
   int run_bad = 0;     /* If set, run bad malloc (set by -b) */
   int check_heap = 0;  /* If set, run the student heap checker (set by -c) */
   int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+  int max_threads = 0; /* If set, replay in up to this many threads (-p) */
 
   /* temporaries used to compute the performance index */
   double total_log_throughput, total_log_util, average_log_util, average_log_throughput,
@@ -99,7 +108,7 @@ int main(int argc, char** argv) {
   /*
    * Read and interpret the command line arguments
    */
-  while ((c = getopt(argc, argv, "f:t:hvVgcb")) != EOF) {
+  while ((c = getopt(argc, argv, "f:t:hvVgcbp:")) != EOF) {
     switch (c) {
     case 'g': /* Generate summary info for the autograder */
       autograder = 1;
@@ -128,6 +137,13 @@ int main(int argc, char** argv) {
     case 'c':
       check_heap = 1;
       break;
+    case 'p': /* Replay the traces in 1 to max_threads threads */
+      max_threads = atoi(optarg);
+      if (max_threads < 1) {
+        usage();
+        exit(1);
+      }
+      break;
     case 'v': /* Print per-trace performance breakdown */
       verbose = 1;
       break;
@@ -179,6 +195,24 @@ int main(int argc, char** argv) {
     }
   }
 
+  /*
+   * With -p, only measure the allocators in several threads
+   */
+  if (max_threads > 0) {
+    mem_init();
+    for (i = 0; i < num_tracefiles; i++) {
+      trace = read_trace(tracedir, tracefiles[i]);
+      eval_mt(trace, tracefiles[i], max_threads);
+      free_trace(trace);
+    }
+    mem_deinit();
+    for (i = 0; i < num_tracefiles; i++) {
+      free(tracefiles[i]);
+    }
+    free(tracefiles);
+    exit(0);
+  }
+
   /* Initialize the timing package */
   init_fsecs();
 
@@ -600,9 +634,6 @@ static void mem_op(volatile char* raddr, volatile char* waddr) {
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(const malloc_impl_t* impl, trace_t* trace) {
-  int i, index, size, newsize;
-  char* p, *newp, *oldp, *block;
-
   /* Reset the heap and initialize the mm package */
   mem_reset_brk();
   if (impl->init() < 0) {
@@ -610,37 +641,51 @@ static void eval_mm_speed(const malloc_impl_t* impl, trace_t* trace) {
   }
 
   /* Interpret each trace request */
-  for (i = 0; i < trace->num_ops; i++) {
-    switch (trace->ops[i].type) {
+  replay_ops(impl, trace->ops, trace->num_ops, trace->blocks, "eval_mm_speed");
+}
+
+/*
+ * replay_ops - Interpret the requests ops[0..num_ops) of a trace, keeping
+ *    the blocks in blocks.  Errors are reported as coming from where.
+ */
+static void replay_ops(const malloc_impl_t* impl, traceop_t* ops, int num_ops,
+                       char** blocks, const char* where) {
+  int i, index, size, newsize;
+  char* p, *newp, *oldp, *block;
+
+  for (i = 0; i < num_ops; i++) {
+    switch (ops[i].type) {
     case ALLOC: /* malloc */
-      index = trace->ops[i].index;
-      size = trace->ops[i].size;
+      index = ops[i].index;
+      size = ops[i].size;
       if ((p = (char*) impl->malloc(size)) == NULL) {
-        app_error("malloc error in eval_mm_speed");
+        snprintf(msg, MAXLINE, "malloc error in %s", where);
+        app_error(msg);
       }
-      trace->blocks[index] = p;
+      blocks[index] = p;
       break;
 
     case REALLOC: /* realloc */
-      index = trace->ops[i].index;
-      newsize = trace->ops[i].size;
-      oldp = trace->blocks[index];
+      index = ops[i].index;
+      newsize = ops[i].size;
+      oldp = blocks[index];
       if ((newp = (char*) impl->realloc(oldp, newsize)) == NULL) {
-        app_error("realloc error in eval_mm_speed");
+        snprintf(msg, MAXLINE, "realloc error in %s", where);
+        app_error(msg);
       }
-      trace->blocks[index] = newp;
+      blocks[index] = newp;
       break;
 
     case FREE: /* free */
-      index = trace->ops[i].index;
-      block = trace->blocks[index];
+      index = ops[i].index;
+      block = blocks[index];
       impl->free(block);
       break;
 
     case WRITE: /* write */
-      index = trace->ops[i].index;
-      size = trace->ops[i].size;
-      p = trace->blocks[index];
+      index = ops[i].index;
+      size = ops[i].size;
+      p = blocks[index];
       if (size > 1) {
         /* read bytes, do some computation, and write */
         for (int offset = 1; offset < size; offset++) {
@@ -650,7 +695,8 @@ static void eval_mm_speed(const malloc_impl_t* impl, trace_t* trace) {
       break;
 
     default:
-      app_error("Nonexistent request type in eval_mm_speed");
+      snprintf(msg, MAXLINE, "Nonexistent request type in %s", where);
+      app_error(msg);
     }
   }
 }
@@ -714,6 +760,233 @@ static int eval_mm_check(const malloc_impl_t* impl, trace_t* trace, int tracenum
   return 1;
 }
 
+/**********************************************************************
+ * The following functions replay a trace in several threads.  The
+ * blocks of the trace are dealt out to the threads by id, and each
+ * thread replays, in trace order, the requests on its own blocks, so
+ * that no block is ever touched by two threads.
+ **********************************************************************/
+
+#define MT_RUNS 10          /* timed runs per measurement; the best counts */
+#define MT_SAMPLE_OPS 64    /* requests of the trace between two samples of
+                               the heap size */
+
+/* The allocators measured in several threads */
+static const struct {
+  const char* name;
+  const malloc_impl_t* impl;
+} mt_impls[] = {
+  { "libc", &libc_impl },
+  { "my (locked)", &locked_impl },
+  { "thread cache", &tc_impl },
+};
+#define NUM_MT_IMPLS ((int) (sizeof(mt_impls) / sizeof(mt_impls[0])))
+
+/* The requests of one thread */
+typedef struct {
+  const malloc_impl_t* impl;
+  traceop_t* ops;
+  int num_ops;
+  char** blocks;
+  pthread_barrier_t* start;
+  pthread_barrier_t* step;  /* if set, replay in rounds and sample the heap
+                               size between them */
+  int rounds;
+  size_t base;         /* heap size before the replay */
+  size_t* peak;        /* largest heap size seen by the sampler, less base */
+  struct timespec begin, end;  /* when the thread started and finished */
+} mt_thread_t;
+
+/*
+ * heap_size - The size of the allocator's heap.  libc cannot be reset
+ *    between runs and keeps the memory it got in earlier ones, so for libc
+ *    this is the memory in use in its chunks instead.
+ */
+static size_t heap_size(const malloc_impl_t* impl) {
+  if (impl->heap_hi() != NULL) {
+    return (char*) impl->heap_hi() + 1 - (char*) impl->heap_lo();
+  }
+#if __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 info = mallinfo2();
+#else
+  struct mallinfo info = mallinfo();
+#endif
+  return (size_t) info.uordblks + (size_t) info.hblkhd;
+}
+
+static void* mt_thread(void* arg) {
+  mt_thread_t* thread = (mt_thread_t*) arg;
+  pthread_barrier_wait(thread->start);
+  clock_gettime(CLOCK_MONOTONIC, &thread->begin);
+  if (thread->step == NULL) {
+    replay_ops(thread->impl, thread->ops, thread->num_ops, thread->blocks,
+               "eval_mt");
+  } else {
+    /* All threads replay the same share of their requests in a round and
+       then wait for each other, and one of them samples the heap size
+       before any goes on. */
+    for (int r = 0; r < thread->rounds; r++) {
+      int from = (long) thread->num_ops * r / thread->rounds;
+      int to = (long) thread->num_ops * (r + 1) / thread->rounds;
+      replay_ops(thread->impl, thread->ops + from, to - from, thread->blocks,
+                 "eval_mt");
+      if (pthread_barrier_wait(thread->step) == PTHREAD_BARRIER_SERIAL_THREAD) {
+        size_t size = heap_size(thread->impl);
+        if (size > thread->base && size - thread->base > *thread->peak) {
+          *thread->peak = size - thread->base;
+        }
+      }
+      pthread_barrier_wait(thread->step);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &thread->end);
+  return NULL;
+}
+
+static double seconds_between(struct timespec begin, struct timespec end) {
+  return (end.tv_sec - begin.tv_sec) + 1E-9 * (end.tv_nsec - begin.tv_nsec);
+}
+
+/*
+ * eval_mt_run - Replay the trace once in num_threads threads.  Returns the
+ *    time from the moment the first thread starts replaying until the last
+ *    one is done.  If sample is set, the threads instead replay in lockstep,
+ *    about MT_SAMPLE_OPS requests of the trace at a time, so that the heap
+ *    holds the blocks of all of them whether or not they run in parallel,
+ *    and the peak heap size is returned in *peak.
+ */
+static double eval_mt_run(const malloc_impl_t* impl, mt_thread_t* threads,
+                          int num_threads, int sample, size_t* peak) {
+  pthread_t ids[num_threads];
+  pthread_barrier_t start;
+  pthread_barrier_t step;
+  size_t sampled = 0;
+
+  impl->reset_brk();
+  if (impl->init() < 0) {
+    app_error("init failed in eval_mt_run");
+  }
+
+  int total_ops = 0;
+  for (int t = 0; t < num_threads; t++) {
+    total_ops += threads[t].num_ops;
+  }
+  int rounds = (total_ops + MT_SAMPLE_OPS - 1) / MT_SAMPLE_OPS;
+
+  pthread_barrier_init(&start, NULL, num_threads + 1);
+  if (sample) {
+    pthread_barrier_init(&step, NULL, num_threads);
+  }
+  size_t base = heap_size(impl);
+  for (int t = 0; t < num_threads; t++) {
+    threads[t].impl = impl;
+    threads[t].start = &start;
+    threads[t].step = sample ? &step : NULL;
+    threads[t].rounds = rounds;
+    threads[t].base = base;
+    threads[t].peak = &sampled;
+    if (pthread_create(&ids[t], NULL, mt_thread, &threads[t]) != 0) {
+      unix_error("pthread_create failed in eval_mt_run");
+    }
+  }
+  pthread_barrier_wait(&start);
+  for (int t = 0; t < num_threads; t++) {
+    pthread_join(ids[t], NULL);
+  }
+  pthread_barrier_destroy(&start);
+  if (sample) {
+    pthread_barrier_destroy(&step);
+  }
+
+  struct timespec begin = threads[0].begin;
+  struct timespec end = threads[0].end;
+  for (int t = 1; t < num_threads; t++) {
+    if (seconds_between(threads[t].begin, begin) > 0) {
+      begin = threads[t].begin;
+    }
+    if (seconds_between(end, threads[t].end) > 0) {
+      end = threads[t].end;
+    }
+  }
+
+  if (sample) {
+    size_t end = heap_size(impl);
+    *peak = end > base && end - base > sampled ? end - base : sampled;
+  }
+  return seconds_between(begin, end);
+}
+
+/*
+ * eval_mt - Print the throughput and peak heap size of every allocator in
+ *    mt_impls replaying the trace in 1, 2, 4, ... up to max_threads
+ *    threads.  The throughput is the best of MT_RUNS runs; the peak heap
+ *    size is sampled every MT_SAMPLE_OPS requests of the trace in a
+ *    separate run, in which the threads replay in lockstep.
+ */
+static void eval_mt(trace_t* trace, char* filename, int max_threads) {
+  mt_thread_t threads[max_threads];
+
+  printf("\n%s: %d ops in up to %d threads\n", filename, trace->num_ops,
+         max_threads);
+  printf("%8s", "threads");
+  for (int k = 0; k < NUM_MT_IMPLS; k++) {
+    printf("%20s", mt_impls[k].name);
+  }
+  printf("\n%8s", "");
+  for (int k = 0; k < NUM_MT_IMPLS; k++) {
+    printf("%11s%9s", "Kops/sec", "heap KB");
+  }
+  printf("\n");
+
+  for (int num_threads = 1;; num_threads *= 2) {
+    if (num_threads > max_threads) {
+      num_threads = max_threads;
+    }
+
+    /* Deal the requests out to the threads by block id.  Each thread
+       keeps its own copy of the block pointers, so that the threads do
+       not write to the same cache lines. */
+    for (int t = 0; t < num_threads; t++) {
+      threads[t].ops = (traceop_t*) malloc(trace->num_ops * sizeof(traceop_t));
+      threads[t].blocks = (char**) malloc(trace->num_ids * sizeof(char*));
+      if (threads[t].ops == NULL || threads[t].blocks == NULL) {
+        unix_error("malloc failed in eval_mt");
+      }
+      threads[t].num_ops = 0;
+    }
+    for (int i = 0; i < trace->num_ops; i++) {
+      mt_thread_t* thread = &threads[trace->ops[i].index % num_threads];
+      thread->ops[thread->num_ops++] = trace->ops[i];
+    }
+
+    printf("%8d", num_threads);
+    for (int k = 0; k < NUM_MT_IMPLS; k++) {
+      size_t peak;
+      eval_mt_run(mt_impls[k].impl, threads, num_threads, 1, &peak);
+      double secs = eval_mt_run(mt_impls[k].impl, threads, num_threads, 0,
+                                NULL);
+      for (int run = 1; run < MT_RUNS; run++) {
+        double run_secs = eval_mt_run(mt_impls[k].impl, threads, num_threads,
+                                      0, NULL);
+        if (run_secs < secs) {
+          secs = run_secs;
+        }
+      }
+      printf("%11.0f%9.0f", trace->num_ops / secs / 1e3, peak / 1024.0);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    for (int t = 0; t < num_threads; t++) {
+      free(threads[t].ops);
+      free(threads[t].blocks);
+    }
+    if (num_threads == max_threads) {
+      break;
+    }
+  }
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -811,7 +1084,7 @@ void malloc_error(int tracenum, int opnum, char* msg) {
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-  fprintf(stderr, "Usage: mdriver [-hvVgc] [-f <file>] [-t <dir>]\n");
+  fprintf(stderr, "Usage: mdriver [-hvVgc] [-f <file>] [-t <dir>] [-p <n>]\n");
   fprintf(stderr, "Options\n");
   fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
   fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
@@ -819,5 +1092,6 @@ static void usage(void) {
   fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
   fprintf(stderr, "\t-V         Print additional debug info.\n");
   fprintf(stderr, "\t-c         Check the heap after every operation.\n");
+  fprintf(stderr, "\t-p <n>     Only measure each allocator in 1 to <n> threads.\n");
   fprintf(stderr, "\t-h         Print this message.\n");
 }
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// Size classes for the slabs in allocator.c and the thread caches in
+// thread_cache.c.  Classes are step bytes apart up to
+// SIZE_CLASS_LINEAR_MAX bytes, then four to each power of 2, about 25%
+// apart.
+
+#ifndef MM_SIZE_CLASSES_H
+#define MM_SIZE_CLASSES_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#define SIZE_CLASS_LINEAR_MAX 128
+
+// Fills sizes with the classes of up to max_size bytes, and returns how
+// many there are.
+static inline int size_classes_make(uint32_t* sizes, uint32_t step,
+                                    uint32_t max_size) {
+  int c = 0;
+  for (uint32_t size = step;
+       size <= SIZE_CLASS_LINEAR_MAX && size <= max_size; size += step) {
+    sizes[c++] = size;
+  }
+  for (uint32_t power = 2 * SIZE_CLASS_LINEAR_MAX; power <= max_size;
+       power *= 2) {
+    for (uint32_t size = power * 5 / 8; size <= power; size += power / 8) {
+      sizes[c++] = size;
+    }
+  }
+  return c;
+}
+
+// Sets class_of[i] to the smallest class of at least i * step bytes, for
+// every i up to max_size / step.
+static inline void size_classes_index(uint8_t* class_of, const uint32_t* sizes,
+                                      uint32_t step, uint32_t max_size) {
+  int c = 0;
+  for (uint32_t i = 0; i <= max_size / step; i++) {
+    while (sizes[c] < i * step) {
+      c++;
+    }
+    class_of[i] = c;
+  }
+}
+
+#endif  // MM_SIZE_CLASSES_H
@@ -0,0 +1,272 @@
+/**
+ * Copyright (c) 2015 MIT License by 6.172 Staff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ **/
+
+// A thread-caching front end for the allocator in allocator.c, in the
+// manner of tcmalloc.
+//
+// Requests of up to TC_MAX_SIZE bytes are rounded up to a size class, and
+// every thread keeps a free list of blocks for each class, which it uses
+// without locking.  When a thread's list runs dry it takes a batch of
+// blocks from the central list of the class, which has its own lock, or
+// failing that gets them from the heap with my_malloc.  When a list grows
+// too long, a batch goes back to the central list, and when that one grows
+// too long, its surplus goes back to the heap with my_free, which
+// coalesces it.  Larger requests go straight to the heap.  The heap is
+// locked_allocator.c's, behind its lock.
+//
+// Cached blocks are ordinary used blocks of the heap, so a block's class
+// is found from its size, whichever thread frees it.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include "./allocator_interface.h"
+#include "./size_classes.h"
+
+// Don't call libc malloc!
+#define malloc(...) (USE_TC_MALLOC)
+#define free(...) (USE_TC_FREE)
+#define realloc(...) (USE_TC_REALLOC)
+
+// Classes are 16 bytes apart, then as in size_classes.h.
+#define TC_MAX_SIZE 1024
+#define TC_NUM_CLASSES 20
+
+// A batch is about TC_BATCH_BYTES, and between TC_MIN_BATCH and
+// TC_MAX_BATCH blocks.
+#define TC_BATCH_BYTES 4096
+#define TC_MIN_BATCH 4
+#define TC_MAX_BATCH 32
+
+// A thread keeps up to 2 batches of each class, and the central lists up
+// to TC_CENTRAL_BATCHES.
+#define TC_CENTRAL_BATCHES 4
+
+typedef struct {
+  void* head;  // blocks linked through their first word
+  int count;
+} tc_list_t;
+
+typedef struct {
+  unsigned generation;  // tc_generation when the lists were emptied
+  int registered;       // set when thread exit will flush the lists
+  tc_list_t lists[TC_NUM_CLASSES];
+} thread_cache_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+  tc_list_t list;
+} tc_central_t;
+
+static uint32_t class_size[TC_NUM_CLASSES];
+static int class_batch[TC_NUM_CLASSES];
+// Class of each request size, indexed by (size + 15) / 16.
+static uint8_t class_of[TC_MAX_SIZE / 16 + 1];
+
+static tc_central_t central[TC_NUM_CLASSES];
+
+// Bumped by tc_init, which throws away the heap and with it every block in
+// the thread caches.
+static unsigned tc_generation;
+
+static __thread thread_cache_t cache;
+static pthread_key_t cache_key;
+static pthread_once_t tc_once = PTHREAD_ONCE_INIT;
+
+static void flush_cache(void* arg);
+
+static void setup_classes(void) {
+  int c = size_classes_make(class_size, 16, TC_MAX_SIZE);
+  assert(c == TC_NUM_CLASSES);
+  size_classes_index(class_of, class_size, 16, TC_MAX_SIZE);
+
+  for (c = 0; c < TC_NUM_CLASSES; c++) {
+    int batch = TC_BATCH_BYTES / class_size[c];
+    class_batch[c] = batch < TC_MIN_BATCH ? TC_MIN_BATCH
+                     : batch > TC_MAX_BATCH ? TC_MAX_BATCH : batch;
+    pthread_mutex_init(&central[c].lock, NULL);
+  }
+  pthread_key_create(&cache_key, flush_cache);
+}
+
+// The largest class whose blocks fit in usable bytes.
+static inline int floor_class(size_t usable) {
+  int c = class_of[usable / 16];
+  return class_size[c] > usable ? c - 1 : c;
+}
+
+// The calling thread's cache, emptied if the heap was reset since it was
+// last used.
+static inline thread_cache_t* get_cache(void) {
+  thread_cache_t* tc = &cache;
+  unsigned generation = __atomic_load_n(&tc_generation, __ATOMIC_ACQUIRE);
+  if (tc->generation != generation) {
+    memset(tc->lists, 0, sizeof(tc->lists));
+    tc->generation = generation;
+    if (!tc->registered) {
+      pthread_setspecific(cache_key, tc);
+      tc->registered = 1;
+    }
+  }
+  return tc;
+}
+
+static inline void push(tc_list_t* list, void* p) {
+  *(void**)p = list->head;
+  list->head = p;
+  list->count++;
+}
+
+static inline void* pop(tc_list_t* list) {
+  void* p = list->head;
+  list->head = *(void**)p;
+  list->count--;
+  return p;
+}
+
+// Moves n blocks from the front of from to the front of to.
+static void move_blocks(tc_list_t* from, tc_list_t* to, int n) {
+  for (int i = 0; i < n; i++) {
+    push(to, pop(from));
+  }
+}
+
+// Returns the blocks of list to the heap.
+static void release_blocks(tc_list_t* list) {
+  if (list->head == NULL) {
+    return;
+  }
+  locked_lock();
+  while (list->head != NULL) {
+    my_free(pop(list));
+  }
+  locked_unlock();
+}
+
+// Fills the empty list of class c with a batch of blocks.
+static void refill(tc_list_t* list, int c) {
+  int batch = class_batch[c];
+
+  pthread_mutex_lock(&central[c].lock);
+  int n = central[c].list.count < batch ? central[c].list.count : batch;
+  move_blocks(&central[c].list, list, n);
+  pthread_mutex_unlock(&central[c].lock);
+
+  if (n < batch) {
+    locked_lock();
+    for (; n < batch; n++) {
+      push(list, my_malloc(class_size[c]));
+    }
+    locked_unlock();
+  }
+}
+
+// Moves n blocks from list to the central list of class c, and the
+// central list's surplus to the heap.
+static void flush(tc_list_t* list, int c, int n) {
+  tc_list_t surplus = { NULL, 0 };
+
+  pthread_mutex_lock(&central[c].lock);
+  move_blocks(list, &central[c].list, n);
+  int excess = central[c].list.count - TC_CENTRAL_BATCHES * class_batch[c];
+  if (excess > 0) {
+    move_blocks(&central[c].list, &surplus, excess);
+  }
+  pthread_mutex_unlock(&central[c].lock);
+
+  release_blocks(&surplus);
+}
+
+// Hands the lists of an exiting thread to the central lists.
+static void flush_cache(void* arg) {
+  thread_cache_t* tc = (thread_cache_t*) arg;
+  if (tc->generation != __atomic_load_n(&tc_generation, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  for (int c = 0; c < TC_NUM_CLASSES; c++) {
+    flush(&tc->lists[c], c, tc->lists[c].count);
+  }
+}
+
+int tc_init() {
+  pthread_once(&tc_once, setup_classes);
+
+  int result = locked_init();
+
+  for (int c = 0; c < TC_NUM_CLASSES; c++) {
+    pthread_mutex_lock(&central[c].lock);
+    central[c].list.head = NULL;
+    central[c].list.count = 0;
+    pthread_mutex_unlock(&central[c].lock);
+  }
+  __atomic_add_fetch(&tc_generation, 1, __ATOMIC_RELEASE);
+  return result;
+}
+
+void* tc_malloc(size_t size) {
+  if (size > TC_MAX_SIZE) {
+    return locked_malloc(size);
+  }
+
+  int c = class_of[(size + 15) / 16];
+  tc_list_t* list = &get_cache()->lists[c];
+  if (list->head == NULL) {
+    refill(list, c);
+  }
+  return pop(list);
+}
+
+void tc_free(void* ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  size_t usable = my_usable_size(ptr);
+  if (usable > TC_MAX_SIZE) {
+    locked_free(ptr);
+    return;
+  }
+
+  int c = floor_class(usable);
+  tc_list_t* list = &get_cache()->lists[c];
+  push(list, ptr);
+  if (list->count > 2 * class_batch[c]) {
+    flush(list, c, class_batch[c]);
+  }
+}
+
+void* tc_realloc(void* ptr, size_t size) {
+  size_t usable = my_usable_size(ptr);
+
+  // The heap can grow or shrink large blocks in place.
+  if (usable > TC_MAX_SIZE) {
+    return locked_realloc(ptr, size);
+  }
+
+  if (size <= usable) {
+    return ptr;
+  }
+  void* p = tc_malloc(size);
+  memcpy(p, ptr, usable);
+  tc_free(ptr);
+  return p;
+}